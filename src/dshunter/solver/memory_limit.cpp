@@ -0,0 +1,90 @@
+#include "memory_limit.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <string>
+
+namespace DSHunter {
+namespace {
+
+constexpr uint64_t UNLIMITED = std::numeric_limits<uint64_t>::max();
+
+// Returns the number in the file, or UNLIMITED if it can't be read or says "max".
+uint64_t readLimit(const std::string &path) {
+    std::ifstream in(path);
+    uint64_t res;
+    if (!(in >> res))
+        return UNLIMITED;
+    return res;
+}
+
+// Returns the value of the /proc/meminfo field, in bytes, or UNLIMITED if it is missing.
+uint64_t readMeminfo(const std::string &field) {
+    std::ifstream in("/proc/meminfo");
+    std::string name;
+    uint64_t kb;
+    while (in >> name >> kb) {
+        in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        if (name == field + ":")
+            return kb << 10;
+    }
+    return UNLIMITED;
+}
+
+// Returns the lowest limit in the file of the given cgroup and of the ones above it under root.
+// Inside a container the cgroup of the process is often the root of the mounted hierarchy, then
+// only root has the file.
+uint64_t cgroupLimit(const std::string &root, std::string cgroup, const std::string &file) {
+    uint64_t res = readLimit(root + "/" + file);
+    while (!cgroup.empty() && cgroup != "/") {
+        res = std::min(res, readLimit(root + cgroup + "/" + file));
+        cgroup.resize(cgroup.find_last_of('/'));
+    }
+    return res;
+}
+
+uint64_t readMemoryLimit() {
+    uint64_t res = readMeminfo("MemTotal");
+
+    // Lines of /proc/self/cgroup are "id:controllers:path", v2 having id 0 and no controllers.
+    std::ifstream in("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(in, line)) {
+        const size_t a = line.find(':'), b = line.find(':', a + 1);
+        if (a == std::string::npos || b == std::string::npos)
+            continue;
+        const std::string controllers = line.substr(a + 1, b - a - 1), path = line.substr(b + 1);
+        if (line.starts_with("0::"))
+            res = std::min(res, cgroupLimit("/sys/fs/cgroup", path, "memory.max"));
+        else if (("," + controllers + ",").find(",memory,") != std::string::npos)
+            res = std::min(res, cgroupLimit("/sys/fs/cgroup/memory", path, "memory.limit_in_bytes"));
+    }
+    return res;
+}
+
+}  // namespace
+
+uint64_t memoryLimit() {
+    static const uint64_t limit = readMemoryLimit();
+    return limit;
+}
+
+uint64_t residentMemory() {
+    // Fields of /proc/self/statm are sizes in pages, the resident ones followed by those backed by
+    // files.
+    std::ifstream in("/proc/self/statm");
+    uint64_t size, resident, shared;
+    if (!(in >> size >> resident >> shared))
+        return 0;
+    return (resident - std::min(resident, shared)) * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+uint64_t memoryLeft(uint64_t limit) {
+    const uint64_t usable = limit - limit / 16, resident = residentMemory();
+    return std::min(usable - std::min(usable, resident), readMeminfo("MemAvailable"));
+}
+
+}  // namespace DSHunter
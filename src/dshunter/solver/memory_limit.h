@@ -0,0 +1,21 @@
+#ifndef DS_MEMORY_LIMIT_H
+#define DS_MEMORY_LIMIT_H
+#include <cstdint>
+
+namespace DSHunter {
+
+// Returns the most memory the process may take: the lowest of the limits of its cgroup and the
+// cgroups above it, v2 or v1, and the total memory of the machine. Read once, at the first call.
+uint64_t memoryLimit();
+
+// Returns the anonymous resident memory of the process, as in /proc/self/statm, or 0 if unknown.
+// Pages of mapped files are left out, they are written back rather than kill the process.
+uint64_t residentMemory();
+
+// Returns the memory the process can still take without going over limit bytes in total, with a
+// sixteenth of the limit kept aside for allocations nobody plans for, nor over what the machine
+// has available.
+uint64_t memoryLeft(uint64_t limit);
+
+}  // namespace DSHunter
+#endif  // DS_MEMORY_LIMIT_H
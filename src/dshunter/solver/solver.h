@@ -6,6 +6,7 @@
 
 #include "../instance.h"
 #include "../rrules/rrules.h"
+#include "memory_limit.h"
 namespace DSHunter {
 using namespace std::chrono_literals;
 enum class SolverType {
@@ -27,13 +28,20 @@ struct SolverConfig {
     SolverType solver_type;
     PresolverType presolver_type;
     std::chrono::seconds decomposition_time_budget;
-    std::string decomposer_path;
+    // External decomposers run side by side instead of FlowCutter, none if empty.
+    std::vector<std::string> decomposer_paths;
+    // Directory for DP tables that don't fit in memory, tables are only kept in memory if empty.
+    std::string spill_directory;
+    // Directory keeping the best decomposition found for each graph across runs, none if empty.
+    std::string decomposition_cache_directory;
     int random_seed;
     int good_enough_treewidth;
     int max_treewidth;
+    // Memory the whole process may take, the limit of its cgroup or of the machine by default.
     size_t max_memory_in_bytes;
     int max_bag_branch_depth;
     int max_branching_reductions_complexity;
+    int n_threads;
     std::chrono::time_point<std::chrono::steady_clock> solve_start;
 
     SolverConfig(std::vector<ReductionRule> rrules, const SolverType st, const PresolverType pt)
@@ -44,9 +52,10 @@ struct SolverConfig {
           random_seed(0),
           good_enough_treewidth(14),
           max_treewidth(18),
-          max_memory_in_bytes(14UL << 30UL),
+          max_memory_in_bytes(memoryLimit()),
           max_bag_branch_depth(7),
-          max_branching_reductions_complexity(0) {}
+          max_branching_reductions_complexity(0),
+          n_threads(1) {}
 
     SolverConfig() : SolverConfig(DSHunter::get_default_reduction_rules(), SolverType::Default, PresolverType::Full) {}
     [[nodiscard]] int64_t millisElapsed() const {
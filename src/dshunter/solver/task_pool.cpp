@@ -0,0 +1,110 @@
+#include "task_pool.h"
+
+#include <optional>
+#include <utility>
+
+#include "../utils.h"
+
+namespace DSHunter {
+namespace {
+// The pool the calling thread works for and its deque, the shared deque 0 for other threads.
+thread_local const TaskPool *current_pool = nullptr;
+thread_local size_t current_queue = 0;
+}  // namespace
+
+TaskPool::TaskPool(int n_threads) {
+    const int n_workers = std::max(n_threads, 1) - 1;
+    for (int i = 0; i <= n_workers; i++) queues.push_back(std::make_unique<Queue>());
+    for (int i = 1; i <= n_workers; i++) workers.emplace_back([this, i] { work(i); });
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard lock(sleep_m);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) worker.join();
+}
+
+int TaskPool::size() const { return static_cast<int>(workers.size()) + 1; }
+
+size_t TaskPool::ownQueue() const { return current_pool == this ? current_queue : 0; }
+
+void TaskPool::spawn(Group &group, std::function<void()> f) {
+    group.pending++;
+    {
+        auto &queue = *queues[ownQueue()];
+        std::lock_guard lock(queue.m);
+        queue.tasks.push_back(Task{ std::move(f), &group });
+    }
+    {
+        std::lock_guard lock(sleep_m);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+void TaskPool::wait(Group &group) {
+    while (group.pending > 0) {
+        if (!runOne()) {
+            std::unique_lock lock(sleep_m);
+            wake.wait(lock, [&] { return group.pending == 0 || queued > 0; });
+        }
+    }
+
+    std::lock_guard lock(group.m);
+    if (group.error)
+        std::rethrow_exception(std::exchange(group.error, nullptr));
+}
+
+bool TaskPool::runOne() {
+    std::optional<Task> task;
+    const size_t own = ownQueue();
+    for (size_t i = 0; i < queues.size() && !task.has_value(); i++) {
+        auto &queue = *queues[(own + i) % queues.size()];
+        std::lock_guard lock(queue.m);
+        if (queue.tasks.empty())
+            continue;
+        // Our own newest task has its data still in cache, others' oldest is likely the biggest.
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+    if (!task.has_value())
+        return false;
+    queued--;
+
+    try {
+        task->f();
+    } catch (...) {
+        std::lock_guard lock(task->group->m);
+        if (!task->group->error)
+            task->group->error = std::current_exception();
+    }
+
+    if (--task->group->pending == 0) {
+        std::lock_guard lock(sleep_m);
+        wake.notify_all();
+    }
+    return true;
+}
+
+void TaskPool::work(size_t id) {
+    current_pool = this;
+    current_queue = id;
+    while (true) {
+        if (runOne())
+            continue;
+        std::unique_lock lock(sleep_m);
+        wake.wait(lock, [&] { return stop || queued > 0; });
+        if (stop)
+            return;
+    }
+}
+
+}  // namespace DSHunter
@@ -0,0 +1,82 @@
+#ifndef DS_TASK_POOL_H
+#define DS_TASK_POOL_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace DSHunter {
+
+// Work-stealing pool of threads for fork-join parallelism.
+// Every worker keeps its own deque of tasks, running the newest of its own tasks first and
+// stealing the oldest task of another worker when it runs out of them. Threads outside the pool
+// share one more deque. Waiting for a group of tasks runs pending tasks instead of blocking,
+// so tasks may spawn and wait for tasks of their own.
+class TaskPool {
+   public:
+    // Set of spawned tasks that can be waited for together.
+    class Group {
+        friend class TaskPool;
+        std::atomic<int> pending{ 0 };
+        std::mutex m;
+        std::exception_ptr error;
+    };
+
+    // Starts n_threads - 1 workers, the thread waiting for tasks being the last one.
+    explicit TaskPool(int n_threads);
+    ~TaskPool();
+
+    TaskPool(const TaskPool &) = delete;
+    TaskPool &operator=(const TaskPool &) = delete;
+
+    [[nodiscard]] int size() const;
+
+    void spawn(Group &group, std::function<void()> f);
+
+    // Returns once all tasks of the group are done, rethrowing the first exception among them.
+    void wait(Group &group);
+
+    // Calls f(begin, end) for consecutive chunks of [0, n) of the given size, in parallel.
+    template <class F>
+    void parallelFor(size_t n, size_t chunk, const F &f) {
+        Group group;
+        for (size_t begin = 0; begin < n; begin += chunk) {
+            const size_t end = std::min(n, begin + chunk);
+            spawn(group, [&f, begin, end] { f(begin, end); });
+        }
+        wait(group);
+    }
+
+   private:
+    struct Task {
+        std::function<void()> f;
+        Group *group;
+    };
+
+    struct Queue {
+        std::mutex m;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleep_m;
+    std::condition_variable wake;
+    std::atomic<int> queued{ 0 };
+    bool stop = false;
+
+    // Index of the deque owned by the calling thread.
+    [[nodiscard]] size_t ownQueue() const;
+    bool runOne();
+    void work(size_t id);
+};
+
+}  // namespace DSHunter
+#endif  // DS_TASK_POOL_H
@@ -0,0 +1,86 @@
+#include "branching_overlay.h"
+
+namespace DSHunter {
+
+BranchingOverlay::BranchingOverlay(const Instance &g, const TreeDecomposition &td)
+    : g(g),
+      td(td),
+      removed(g.all_nodes.size(), false),
+      dominated(g.all_nodes.size(), false),
+      degree(g.all_nodes.size(), 0),
+      bag_size(td.size()),
+      bags_of(g.all_nodes.size()) {
+    for (int v : g.nodes) degree[v] = g.deg(v);
+    for (int i = 0; i < td.size(); i++) {
+        bag_size[i] = td.bag[i].size();
+        for (int v : td.bag[i]) bags_of[v].push_back(i);
+    }
+}
+
+std::vector<int> BranchingOverlay::dominators(int v) const {
+    // Taking and ignoring vertices only removes dominators.
+    std::vector<int> res;
+    for (int u : g[v].dominators) {
+        if (!removed[u])
+            res.push_back(u);
+    }
+    return res;
+}
+
+void BranchingOverlay::take(int v) {
+    DS_ASSERT(hasNode(v) && !isDisregarded(v));
+    for (int u : g[v].dominatees) {
+        if (!removed[u])
+            markDominated(u);
+    }
+    remove(v);
+}
+
+void BranchingOverlay::ignore(int v) {
+    if (!hasNode(v))
+        return;
+
+    remove(v);
+    for (auto [u, status] : g[v].adj) {
+        if (status == EdgeStatus::FORCED && hasNode(u))
+            take(u);
+    }
+}
+
+void BranchingOverlay::undo(size_t checkpoint) {
+    while (log.size() > checkpoint) {
+        auto [v, change] = log.back();
+        log.pop_back();
+        if (change == Change::Dominated) {
+            dominated[v] = false;
+            continue;
+        }
+
+        // The neighbours left are the ones that were left when v was removed.
+        removed[v] = false;
+        for (auto [u, _] : g[v].adj) {
+            if (!removed[u])
+                degree[u]++;
+        }
+        for (int i : bags_of[v]) bag_size[i]++;
+    }
+}
+
+void BranchingOverlay::remove(int v) {
+    removed[v] = true;
+    for (auto [u, _] : g[v].adj) {
+        if (!removed[u])
+            degree[u]--;
+    }
+    for (int i : bags_of[v]) bag_size[i]--;
+    log.emplace_back(v, Change::Removed);
+}
+
+void BranchingOverlay::markDominated(int v) {
+    if (isDominated(v))
+        return;
+    dominated[v] = true;
+    log.emplace_back(v, Change::Dominated);
+}
+
+}  // namespace DSHunter
@@ -0,0 +1,68 @@
+#ifndef DS_BRANCHING_OVERLAY_H
+#define DS_BRANCHING_OVERLAY_H
+#include <utility>
+#include <vector>
+
+#include "../../instance.h"
+#include "td/tree_decomposition.h"
+
+namespace DSHunter {
+
+// View of an instance and its decomposition with some vertices taken or ignored, as by
+// Instance::take and Instance::ignore, tracking only what picking the vertex to branch on needs:
+// which vertices are left and dominated, their degrees and the sizes of the bags. Ignored vertices
+// leave the bags too: the DP of a leaf gives them a single color, so they don't add to its width.
+// Changes are undone in reverse order, so that the whole bag-branching tree is walked over a single
+// overlay instead of a copy of the instance per node.
+class BranchingOverlay {
+   public:
+    BranchingOverlay(const Instance &g, const TreeDecomposition &td);
+
+    [[nodiscard]] const TreeDecomposition &decomposition() const { return td; }
+    // Returns one more than the largest vertex id, as all_nodes.size() of the instance.
+    [[nodiscard]] size_t idBound() const { return removed.size(); }
+
+    [[nodiscard]] bool hasNode(int v) const { return g.hasNode(v) && !removed[v]; }
+    [[nodiscard]] bool isDominated(int v) const { return g.isDominated(v) || dominated[v]; }
+    [[nodiscard]] bool isDisregarded(int v) const { return g.isDisregarded(v); }
+    [[nodiscard]] int deg(int v) const { return degree[v]; }
+    [[nodiscard]] int bagSize(int i) const { return bag_size[i]; }
+
+    // Returns the vertices left that can dominate v.
+    [[nodiscard]] std::vector<int> dominators(int v) const;
+
+    // Calls f(v) for the vertices left in bag i, in the order of the decomposition.
+    template <class F>
+    void forEachInBag(int i, F &&f) const {
+        for (int v : td.bag[i]) {
+            if (!removed[v])
+                f(v);
+        }
+    }
+
+    void take(int v);
+    void ignore(int v);
+
+    // Returns the state to pass to undo to revert the changes made from now on.
+    [[nodiscard]] size_t checkpoint() const { return log.size(); }
+    void undo(size_t checkpoint);
+
+   private:
+    enum class Change {
+        Removed,
+        Dominated
+    };
+
+    const Instance &g;
+    const TreeDecomposition &td;
+    std::vector<bool> removed, dominated;
+    std::vector<int> degree, bag_size;
+    std::vector<std::vector<int>> bags_of;
+    std::vector<std::pair<int, Change>> log;
+
+    void remove(int v);
+    void markDominated(int v);
+};
+
+}  // namespace DSHunter
+#endif  // DS_BRANCHING_OVERLAY_H
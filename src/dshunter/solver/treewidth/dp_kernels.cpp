@@ -0,0 +1,585 @@
+#include "dp_kernels.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+#include "../../utils.h"
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define DS_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define DS_TARGET_CLONES
+#endif
+
+namespace DSHunter {
+namespace {
+
+constexpr int INF = DPTable::INF;
+
+// Runs shorter than this are walked by plain loops, the call overhead outweighs vectorization.
+constexpr size_t SHORT_RUN = 8;
+
+// Number of states computed by one parallel task.
+constexpr size_t CHUNK_STATES = size_t{ 1 } << 16;
+
+// Calls f(begin, end) on chunks of [0, n), in parallel if there is a pool and more than one chunk.
+template <class F>
+void forChunks(TaskPool *pool, size_t n, size_t chunk, const F &f) {
+    chunk = std::max<size_t>(chunk, 1);
+    if (pool == nullptr || n <= chunk)
+        f(0, n);
+    else
+        pool->parallelFor(n, chunk, f);
+}
+
+// Offsets are combined as uint32_t, infeasible states being UINT32_MAX, and narrowed back to the
+// output type, where offsets above the limit of the table become infeasible. The limit may be
+// below the offsets of the input when states are pruned, so they can't be converted directly.
+constexpr uint32_t WIDE_SATURATED = DPTable::SATURATED<uint32_t>;
+
+template <class TI>
+inline uint32_t widen(TI x) {
+    return x == DPTable::SATURATED<TI> ? WIDE_SATURATED : static_cast<uint32_t>(x);
+}
+
+// Adds cost to an offset, saturating at the infeasible value.
+template <class TI>
+inline uint32_t add(TI x, uint32_t cost) {
+    return x == DPTable::SATURATED<TI> ? WIDE_SATURATED : static_cast<uint32_t>(x) + cost;
+}
+
+template <class TO>
+inline TO narrow(uint32_t x, uint32_t limit) {
+    return x > limit ? DPTable::SATURATED<TO> : static_cast<TO>(x);
+}
+
+template <class TI, class TO>
+DS_TARGET_CLONES void minPlusRun(const TI *keep, const TI *take, uint32_t cost, TO *out, size_t len, uint32_t limit) {
+    for (size_t i = 0; i < len; i++) out[i] = narrow<TO>(std::min(widen(keep[i]), add(take[i], cost)), limit);
+}
+
+template <class TI, class TO>
+DS_TARGET_CLONES void minAddRun(const TI *x, uint32_t cost, TO *out, size_t len, uint32_t limit) {
+    for (size_t i = 0; i < len; i++) out[i] = std::min(out[i], narrow<TO>(add(x[i], cost), limit));
+}
+
+template <class TI, class TO>
+DS_TARGET_CLONES void convertRun(const TI *x, TO *out, size_t len, uint32_t limit) {
+    for (size_t i = 0; i < len; i++) out[i] = narrow<TO>(widen(x[i]), limit);
+}
+
+DS_TARGET_CLONES void addRun(const int64_t *x, int64_t *out, size_t len) {
+    for (size_t i = 0; i < len; i++) out[i] += x[i];
+}
+
+DS_TARGET_CLONES void subRun(const int64_t *x, int64_t *out, size_t len) {
+    for (size_t i = 0; i < len; i++) out[i] -= x[i];
+}
+
+DS_TARGET_CLONES void mulAddRun(const int64_t *x, const int64_t *y, int64_t *out, size_t len) {
+    for (size_t i = 0; i < len; i++) out[i] += x[i] * y[i];
+}
+
+// Applies the zeta (or Möbius) transform over the subset lattice of m bits in place.
+// For every bit the masks containing it form runs following the runs of masks that don't.
+void subsetTransform(int64_t *a, int m, bool inverse) {
+    const size_t n = size_t{ 1 } << m;
+    for (int bit = 0; bit < m; bit++) {
+        const size_t h = size_t{ 1 } << bit;
+        for (size_t base = 0; base < n; base += 2 * h) {
+            if (h < SHORT_RUN) {
+                for (size_t i = 0; i < h; i++) a[base + h + i] += inverse ? -a[base + i] : a[base + i];
+            } else if (inverse) {
+                subRun(a + base, a + base + h, h);
+            } else {
+                addRun(a + base, a + base + h, h);
+            }
+        }
+    }
+}
+
+struct Spread {
+    int min;
+    int max;
+};
+
+// Returns the range of feasible values in a, or nullopt if all of them are infeasible.
+std::optional<Spread> spread(const std::vector<int> &a) {
+    Spread s{ INF, -1 };
+    for (int x : a) {
+        if (x < INF) {
+            s.min = std::min(s.min, x);
+            s.max = std::max(s.max, x);
+        }
+    }
+    if (s.max < 0)
+        return std::nullopt;
+    return s;
+}
+
+// Makes the values of a above limit infeasible and shrinks its spread s accordingly.
+void pruneAbove(std::vector<int> &a, int limit, Spread &s) {
+    if (s.max <= limit)
+        return;
+    for (int &x : a) {
+        if (x > limit)
+            x = INF;
+    }
+    s.max = limit;
+}
+
+// For every mask X over m bits computes the number of S ⊆ X with a[S] = base + i, for each i.
+std::vector<int64_t> zetaByCost(const std::vector<int> &a, int m, Spread s) {
+    const size_t n = size_t{ 1 } << m;
+    const int levels = s.max - s.min + 1;
+    std::vector<int64_t> z(levels * n, 0);
+    for (size_t S = 0; S < n; S++) {
+        if (a[S] < INF)
+            z[(a[S] - s.min) * n + S] = 1;
+    }
+
+    for (int i = 0; i < levels; i++) subsetTransform(z.data() + i * n, m, false);
+    return z;
+}
+
+void joinByTransform(const std::vector<int> &a, const std::vector<int> &b, std::vector<int> &res, int m, Spread sa, Spread sb) {
+    const size_t n = size_t{ 1 } << m;
+    const int levels_a = sa.max - sa.min + 1, levels_b = sb.max - sb.min + 1;
+    const int levels = levels_a + levels_b - 1;
+    auto za = zetaByCost(a, m, sa);
+    auto zb = zetaByCost(b, m, sb);
+
+    // prod[s][X] counts the pairs S_1, S_2 ⊆ X with a[S_1] + b[S_2] = sa.min + sb.min + s.
+    std::vector<int64_t> prod(levels * n, 0);
+    for (int i = 0; i < levels_a; i++) {
+        for (int j = 0; j < levels_b; j++) {
+            mulAddRun(za.data() + i * n, zb.data() + j * n, prod.data() + (i + j) * n, n);
+        }
+    }
+
+    // After the Möbius transform, the pairs are counted only if S_1 ∪ S_2 = X.
+    std::fill(res.begin(), res.end(), INF);
+    for (int s = levels - 1; s >= 0; s--) {
+        int64_t *level = prod.data() + s * n;
+        subsetTransform(level, m, true);
+        for (size_t X = 0; X < n; X++) {
+            if (level[X] > 0)
+                res[X] = sa.min + sb.min + s;
+        }
+    }
+}
+
+void joinDirectly(const std::vector<int> &a, const std::vector<int> &b, std::vector<int> &res, int m) {
+    const size_t n = size_t{ 1 } << m;
+    for (size_t S = 0; S < n; S++) {
+        int best = a[0] + b[S];
+        // Iterate over all nonempty S_1 ⊆ S, with S_2 = S \ S_1.
+        for (size_t S_1 = S; S_1 > 0; S_1 = (S_1 - 1) & S) best = std::min(best, a[S_1] + b[S ^ S_1]);
+        res[S] = best;
+    }
+}
+
+// Reads the values of the given states of a table.
+void gather(const DPTable &t, const std::vector<size_t> &index, std::vector<int> &a) {
+    std::visit(
+        [&](const auto &v) {
+            using T = std::decay_t<decltype(v[0])>;
+            for (size_t S = 0; S < index.size(); S++) a[S] = v[index[S]] == DPTable::SATURATED<T> ? INF : t.base + static_cast<int>(v[index[S]]);
+        },
+        t.values);
+}
+
+// Forgets a vertex with radix colors, the child states being hi * radix * run + digit * run + lo
+// and the state hi * run + lo. The vertex is dominated in digit 0 and taken in black_digit, if
+// it can be taken at all.
+template <class TI, class TO>
+void forgetRuns(const TI *child, TO *out, size_t run, size_t n_hi, int radix, int black_digit, int cost_take, uint32_t limit) {
+    const size_t step = radix * run;
+    const TI *white = child, *black = child + black_digit * run;
+    // Skip the branching if we already know the solution would be nonoptimal or pruned.
+    if (black_digit < 0 || cost_take >= INF || static_cast<uint32_t>(cost_take) > limit) {
+        for (size_t hi = 0; hi < n_hi; hi++) convertRun(white + hi * step, out + hi * run, run, limit);
+    } else if (run < SHORT_RUN) {
+        for (size_t hi = 0; hi < n_hi; hi++) {
+            for (size_t lo = 0; lo < run; lo++) {
+                const size_t from = hi * step + lo;
+                out[hi * run + lo] = narrow<TO>(std::min(widen(white[from]), add(black[from], cost_take)), limit);
+            }
+        }
+    } else {
+        for (size_t hi = 0; hi < n_hi; hi++) minPlusRun(white + hi * step, black + hi * step, cost_take, out + hi * run, run, limit);
+    }
+}
+
+// Walks the values of the digits above some position in increasing order, keeping the index of
+// the matching state of another table, in which these digits have the given strides.
+struct DigitWalk {
+    std::vector<int> radix;
+    std::vector<size_t> stride;
+    std::vector<int> digit;
+    size_t index = 0;
+
+    // Starts at the value s.
+    DigitWalk(std::vector<int> digit_radix, std::vector<size_t> digit_stride, size_t s) : radix(std::move(digit_radix)), stride(std::move(digit_stride)), digit(radix.size()) {
+        for (size_t i = 0; i < digit.size(); i++) {
+            digit[i] = static_cast<int>(s % radix[i]);
+            s /= radix[i];
+            index += digit[i] * stride[i];
+        }
+    }
+
+    // Moves to the next value, calling on_change(i, old_digit, new_digit) for each changed digit.
+    template <class F>
+    void next(F &&on_change) {
+        for (size_t i = 0; i < digit.size(); i++) {
+            const int old = digit[i];
+            if (old + 1 < radix[i]) {
+                digit[i]++;
+                index += stride[i];
+                on_change(i, old, old + 1);
+                return;
+            }
+            digit[i] = 0;
+            index -= old * stride[i];
+            on_change(i, old, 0);
+        }
+    }
+
+    void next() {
+        next([](size_t, int, int) {});
+    }
+};
+
+// Child offset and cost of taking some of the vertices forgotten together.
+struct TakeCombo {
+    size_t offset;
+    uint32_t cost;
+};
+
+template <class TI, class TO>
+void forgetCombosRuns(const TI *child, TO *out, size_t run, size_t begin, size_t end, const std::vector<int> &radix, const std::vector<size_t> &stride, const std::vector<TakeCombo> &combos, uint32_t limit) {
+    DigitWalk walk(radix, stride, begin);
+    for (size_t hi = begin; hi < end; hi++, walk.next()) {
+        const TI *src = child + walk.index;
+        TO *dst = out + hi * run;
+        // The first combo takes no vertex.
+        if (run < SHORT_RUN) {
+            for (size_t lo = 0; lo < run; lo++) {
+                uint32_t best = widen(src[lo]);
+                for (size_t i = 1; i < combos.size(); i++) best = std::min(best, add(src[combos[i].offset + lo], combos[i].cost));
+                dst[lo] = narrow<TO>(best, limit);
+            }
+        } else {
+            convertRun(src, dst, run, limit);
+            for (size_t i = 1; i < combos.size(); i++) minAddRun(src + combos[i].offset, combos[i].cost, dst, run, limit);
+        }
+    }
+}
+
+void introduceWithEdges(const DPTable &child, DPTable &out, const StateSpace &space, int pos, const std::vector<IntroducedEdge> &edges) {
+    out.reset(space.size(), child.base, child.max_offset, [&](auto &o) {
+        using T = std::decay_t<decltype(o[0])>;
+        const auto &in = std::get<DPTable::Column<T>>(child.values);
+
+        // States below the lowest position of v or its neighbours form runs copied as a whole.
+        int low = pos;
+        for (auto e : edges) low = std::min(low, e.pos);
+        const size_t run = space.stride[low];
+        const int n_digits = space.n_positions() - low;
+
+        // The digit of a position has the same stride in the child below v, the stride divided by
+        // the radix of v above.
+        std::vector<int> radix(n_digits);
+        std::vector<size_t> stride(n_digits);
+        std::vector<int> edge_at(n_digits, -1);
+        for (int i = 0; i < n_digits; i++) {
+            const int p = low + i;
+            radix[i] = space.colors[p].count;
+            stride[i] = p < pos ? space.stride[p] : p == pos ? 0 : space.stride[p] / space.colors[pos].count;
+        }
+        for (size_t j = 0; j < edges.size(); j++) edge_at[edges[j].pos - low] = j;
+
+        // Offset making all WHITE neighbours GRAY, number of BLACK neighbours and of forced edges
+        // with a neighbour that isn't BLACK, updated as the colors of the positions change.
+        size_t white_offset = 0;
+        int n_black = 0, unsatisfied = 0;
+        auto c_v = space.colors[pos].lowest;
+        auto recolor = [&](size_t i, int sign, Color c) {
+            const int j = edge_at[i];
+            if (j < 0)
+                return;
+            if (c == Color::WHITE)
+                white_offset += sign * stride[i];
+            if (c == Color::BLACK)
+                n_black += sign;
+            else if (edges[j].forced)
+                unsatisfied += sign;
+        };
+        for (int i = 0; i < n_digits; i++) recolor(i, 1, space.colors[low + i].lowest);
+        auto on_change = [&](size_t i, int old_digit, int new_digit) {
+            const auto &colors = space.colors[low + i];
+            if (low + static_cast<int>(i) == pos) {
+                c_v = colors.color(new_digit);
+                return;
+            }
+            recolor(i, -1, colors.color(old_digit));
+            recolor(i, 1, colors.color(new_digit));
+        };
+
+        DigitWalk walk(radix, stride, 0);
+        for (size_t hi = 0; hi < space.size() / run; hi++, walk.next(on_change)) {
+            // A BLACK v dominates its WHITE neighbours, which are GRAY in the child. A WHITE v
+            // isn't dominated yet, so it needs a BLACK neighbour, a forced edge needs a BLACK
+            // endpoint.
+            size_t from = walk.index;
+            bool feasible = true;
+            if (c_v == Color::BLACK)
+                from += white_offset;
+            else
+                feasible = unsatisfied == 0 && (c_v == Color::GRAY || n_black > 0);
+
+            T *dst = o.data() + hi * run;
+            if (feasible)
+                std::copy(in.data() + from, in.data() + from + run, dst);
+            else
+                std::fill(dst, dst + run, DPTable::SATURATED<T>);
+        }
+    });
+}
+
+// Fills the whole table with infeasible states.
+void fillInfeasible(DPTable &out, size_t size) {
+    out.reset(size, 0, 0, [](auto &o) { std::ranges::fill(o, DPTable::SATURATED<std::decay_t<decltype(o[0])>>); });
+}
+
+}  // namespace
+
+void introduceVertex(const DPTable &child, DPTable &out, const StateSpace &space, int pos, const std::vector<IntroducedEdge> &edges) {
+    DS_ASSERT(child.size() == space.size() / space.colors[pos].count);
+    if (!edges.empty()) {
+        introduceWithEdges(child, out, space, pos, edges);
+        return;
+    }
+
+    out.reset(space.size(), child.base, child.max_offset, [&](auto &o) {
+        using T = std::decay_t<decltype(o[0])>;
+        const auto &in = std::get<DPTable::Column<T>>(child.values);
+        // States are hi * stride[pos+1] + digit * stride[pos] + lo, the child state being
+        // hi * stride[pos] + lo. A WHITE v isn't dominated yet, and has no neighbours.
+        const Colors colors = space.colors[pos];
+        const size_t run = space.stride[pos], n_hi = space.size() / space.stride[pos + 1];
+        for (size_t hi = 0; hi < n_hi; hi++) {
+            const T *src = in.data() + hi * run;
+            T *dst = o.data() + hi * colors.count * run;
+            for (int d = 0; d < colors.count; d++, dst += run) {
+                if (colors.color(d) == Color::WHITE)
+                    std::fill(dst, dst + run, DPTable::SATURATED<T>);
+                else
+                    std::copy(src, src + run, dst);
+            }
+        }
+    });
+}
+
+void introduceEdge(const DPTable &child, DPTable &out, const StateSpace &space, int pos_u, int pos_v, bool forced) {
+    DS_ASSERT(child.size() == space.size() && pos_u != pos_v);
+    out.reset(space.size(), child.base, child.max_offset, [&](auto &o) {
+        using T = std::decay_t<decltype(o[0])>;
+        const auto &in = std::get<DPTable::Column<T>>(child.values);
+        const int lo_pos = std::min(pos_u, pos_v), hi_pos = std::max(pos_u, pos_v);
+        const Colors lo_colors = space.colors[lo_pos], hi_colors = space.colors[hi_pos];
+        const size_t run = space.stride[lo_pos], mid = space.stride[hi_pos] / space.stride[lo_pos + 1], n_hi = space.size() / space.stride[hi_pos + 1];
+
+        // For each pair of colors of the endpoints the states form a box of runs, each read from
+        // the child at a fixed offset: a WHITE endpoint of a BLACK one is GRAY in the child.
+        for (int d_lo = 0; d_lo < lo_colors.count; d_lo++) {
+            for (int d_hi = 0; d_hi < hi_colors.count; d_hi++) {
+                const auto c_u = pos_u == lo_pos ? lo_colors.color(d_lo) : hi_colors.color(d_hi);
+                const auto c_v = pos_v == lo_pos ? lo_colors.color(d_lo) : hi_colors.color(d_hi);
+                ptrdiff_t offset = 0;
+                bool feasible = true;
+                if (c_u == Color::BLACK && c_v == Color::WHITE)
+                    offset = space.stride[pos_v];
+                else if (c_u == Color::WHITE && c_v == Color::BLACK)
+                    offset = space.stride[pos_u];
+                else if (forced && c_u != Color::BLACK && c_v != Color::BLACK)
+                    feasible = false;
+
+                for (size_t hi = 0; hi < n_hi; hi++) {
+                    for (size_t m = 0; m < mid; m++) {
+                        const size_t start = ((hi * hi_colors.count + d_hi) * mid + m) * lo_colors.count * run + d_lo * run;
+                        T *dst = o.data() + start;
+                        if (!feasible)
+                            std::fill(dst, dst + run, DPTable::SATURATED<T>);
+                        else
+                            std::copy(in.data() + start + offset, in.data() + start + offset + run, dst);
+                    }
+                }
+            }
+        }
+    });
+}
+
+void forget(const DPTable &child, DPTable &out, const StateSpace &child_space, const std::vector<int> &pos, const std::vector<int> &cost_take, int max_value, TaskPool *pool) {
+    const int k = pos.size();
+    DS_ASSERT(k > 0 && child.size() == child_space.size() && std::ranges::is_sorted(pos));
+    size_t size = child_space.size();
+    for (int p : pos) size /= child_space.colors[p].count;
+
+    // Every state of the child is pruned already, the table is all infeasible.
+    if (child.base > max_value) {
+        fillInfeasible(out, size);
+        return;
+    }
+
+    // The digit of a BLACK forgotten vertex, or -1 for those that can't be taken.
+    std::vector<int> black_digit(k, -1);
+    uint32_t max_offset = child.max_offset;
+    for (int i = 0; i < k; i++) {
+        const Colors colors = child_space.colors[pos[i]];
+        if (colors.has(Color::BLACK) && cost_take[i] < INF) {
+            black_digit[i] = colors.digit(Color::BLACK);
+            max_offset += cost_take[i];
+        }
+    }
+    max_offset = std::min<uint32_t>(max_offset, max_value - child.base);
+
+    // Each forgotten vertex is either dominated in digit 0 or BLACK, taking the BLACK ones.
+    // Combos costing more than the limit only lead to pruned states.
+    std::vector<TakeCombo> combos;
+    for (size_t taken = 0; taken < (size_t{ 1 } << k); taken++) {
+        TakeCombo combo{ 0, 0 };
+        bool feasible = true;
+        for (int i = 0; i < k; i++) {
+            if (taken >> i & 1) {
+                combo.offset += black_digit[i] * child_space.stride[pos[i]];
+                combo.cost += cost_take[i];
+                feasible &= black_digit[i] >= 0;
+            }
+        }
+        if (feasible && combo.cost <= max_offset)
+            combos.push_back(combo);
+    }
+
+    // The digits of the states at or above the lowest forgotten position, skipping the forgotten
+    // ones in the child.
+    std::vector<int> radix;
+    std::vector<size_t> stride;
+    for (int p = pos[0], i = 0; p < child_space.n_positions(); p++) {
+        if (i < k && pos[i] == p) {
+            i++;
+        } else {
+            radix.push_back(child_space.colors[p].count);
+            stride.push_back(child_space.stride[p]);
+        }
+    }
+
+    out.reset(size, child.base, max_offset, [&](auto &o) {
+        std::visit(
+            [&](const auto &in) {
+                const size_t run = child_space.stride[pos[0]], n_hi = size / run;
+                forChunks(pool, n_hi, CHUNK_STATES / run, [&](size_t begin, size_t end) {
+                    if (k == 1) {
+                        const int r = child_space.colors[pos[0]].count;
+                        forgetRuns(in.data() + begin * r * run, o.data() + begin * run, run, end - begin, r, black_digit[0], cost_take[0], max_offset);
+                    } else {
+                        forgetCombosRuns(in.data(), o.data(), run, begin, end, radix, stride, combos, max_offset);
+                    }
+                });
+            },
+            child.values);
+    });
+
+    // The offsets only grow by forgetting, the table is rebased once they no longer fit or all of
+    // its smallest values were pruned.
+    if (out.width() > child.width() || max_offset < child.max_offset)
+        out.normalize();
+}
+
+void join(const DPTable &l, const DPTable &r, DPTable &out, const StateSpace &space, int max_value, TaskPool *pool, uint64_t scratch_limit) {
+    DS_ASSERT(l.size() == space.size() && r.size() == space.size());
+    const int base = l.base + r.base;
+    // Every pair of states sums above max_value, the table is all infeasible.
+    if (base > max_value) {
+        fillInfeasible(out, space.size());
+        return;
+    }
+
+    // Groups are the sets of BLACK positions among those that can be BLACK.
+    std::vector<int> can_be_black;
+    for (int p = 0; p < space.n_positions(); p++) {
+        if (space.colors[p].has(Color::BLACK))
+            can_be_black.push_back(p);
+    }
+    const size_t n_groups = size_t{ 1 } << can_be_black.size();
+
+    const uint32_t max_offset = std::min<uint32_t>(l.max_offset + r.max_offset, max_value - base);
+    out.reset(space.size(), base, max_offset, [&](auto &o) {
+        using T = std::decay_t<decltype(o[0])>;
+        const size_t states_per_group = std::max<size_t>(space.size() / n_groups, 1);
+        forChunks(pool, n_groups, CHUNK_STATES / states_per_group, [&](size_t begin, size_t end) {
+            std::vector<bool> black(space.n_positions());
+            std::vector<int> free_positions;
+            std::vector<size_t> index;
+            std::vector<int> a, b, res;
+            for (size_t group = begin; group < end; group++) {
+                for (size_t i = 0; i < can_be_black.size(); i++) black[can_be_black[i]] = group >> i & 1;
+
+                // Positions that aren't BLACK are GRAY in the first state, those that can be
+                // WHITE are free.
+                free_positions.clear();
+                TernaryFun first = 0;
+                for (int p = 0; p < space.n_positions(); p++) {
+                    const Colors colors = space.colors[p];
+                    first += colors.digit(black[p] ? Color::BLACK : Color::GRAY) * space.stride[p];
+                    if (!black[p] && colors.has(Color::WHITE))
+                        free_positions.push_back(p);
+                }
+
+                // index[S] is the state with WHITE on free positions in S and GRAY on the others.
+                const int m = free_positions.size();
+                const size_t n = size_t{ 1 } << m;
+                index.resize(n);
+                a.resize(n);
+                b.resize(n);
+                res.resize(n);
+                index[0] = first;
+                for (size_t S = 1; S < n; S++) {
+                    int low = std::countr_zero(S);
+                    index[S] = index[S & (S - 1)] - space.stride[free_positions[low]];
+                }
+                gather(l, index, a);
+                gather(r, index, b);
+
+                auto sa = spread(a), sb = spread(b);
+                if (!sa.has_value() || !sb.has_value() || sa->min + sb->min > max_value) {
+                    // The whole group is infeasible or pruned.
+                    std::fill(res.begin(), res.end(), INF);
+                } else {
+                    // Values that exceed max_value with the cheapest state of the other table are
+                    // pruned. Both tables stay monotone, and the transforms get fewer levels.
+                    pruneAbove(a, max_value - sb->min, *sa);
+                    pruneAbove(b, max_value - sa->min, *sb);
+                    const uint64_t levels_a = sa->max - sa->min + 1, levels_b = sb->max - sb->min + 1;
+                    const uint64_t transform_cost = n * (levels_a * levels_b + 2 * m * (levels_a + levels_b));
+                    // The transforms of a, b and their product, one count per level and mask.
+                    const uint64_t transform_bytes = sizeof(int64_t) * n * (2 * (levels_a + levels_b) - 1);
+                    if (transform_bytes <= scratch_limit && (m > MAX_EXPONENT || transform_cost < pow3[m]))
+                        joinByTransform(a, b, res, m, *sa, *sb);
+                    else
+                        joinDirectly(a, b, res, m);
+                }
+
+                // Every state belongs to exactly one group, so chunks write disjoint states.
+                for (size_t S = 0; S < n; S++) o[index[S]] = narrow<T>(res[S] < INF ? res[S] - base : WIDE_SATURATED, max_offset);
+            }
+        });
+    });
+    out.normalize();
+}
+
+}  // namespace DSHunter
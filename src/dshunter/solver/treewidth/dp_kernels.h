@@ -0,0 +1,57 @@
+#ifndef DS_DP_KERNELS_H
+#define DS_DP_KERNELS_H
+#include <cstdint>
+#include <vector>
+
+#include "../task_pool.h"
+#include "dp_table.h"
+#include "state_space.h"
+
+namespace DSHunter {
+
+// Kernels computing whole tables of the nice decomposition nodes from the tables of their children.
+// States are encoded by the StateSpace of the bag. The kernels walk the tables in contiguous runs of
+// states sharing all digits above some position, so that the inner loops vectorize, and the hot
+// loops are compiled for AVX-512, AVX2 and baseline x86-64 with the variant picked at runtime.
+// States of the computed table with values above max_value are infeasible. It is at least the
+// number of vertices forgotten below, unless states that can't beat an incumbent solution are
+// pruned, forget and join then skip the groups of states that only lead to pruned ones.
+// Given a pool, forget and join split large tables into chunks of a few L2-sized blocks of states
+// and compute them in parallel.
+
+// Edge introduced along with a vertex, to the vertex at position pos of the new bag.
+struct IntroducedEdge {
+    int pos;
+    bool forced;
+};
+
+// Fills the table of an IntroduceVertex node of v at position pos of the new bag with the given
+// states, introducing the given edges of v as well, as IntroduceEdge nodes following it would.
+// States with v WHITE are infeasible unless one of these neighbours is BLACK, a dominated v has no
+// WHITE states.
+void introduceVertex(const DPTable &child, DPTable &out, const StateSpace &space, int pos, const std::vector<IntroducedEdge> &edges = {});
+
+// Fills the table of an IntroduceEdge node of u at position pos_u and v at position pos_v.
+// If the edge is forced, states with neither endpoint BLACK are infeasible.
+void introduceEdge(const DPTable &child, DPTable &out, const StateSpace &space, int pos_u, int pos_v, bool forced);
+
+// Fills the table of a Forget node of the vertices at the given increasing positions of the child
+// bag with the given states, taking the ith of them costs cost_take[i].
+void forget(const DPTable &child, DPTable &out, const StateSpace &child_space, const std::vector<int> &pos, const std::vector<int> &cost_take, int max_value, TaskPool *pool = nullptr);
+
+// Fills the table of a Join node with the given states from the tables of its children.
+// For f with WHITE positions Z, out[f] is the minimum of l[f_1] + r[f_2] over f_1, f_2 that agree
+// with f outside Z, and whose WHITE positions cover Z.
+//
+// States are grouped by their BLACK positions, within a group the WHITE positions form a subset
+// lattice. Tables are monotone (WHITE is never cheaper than GRAY), so the join of a group is a
+// covering product over that lattice. It is computed in O(2^m * (m * M + M^2)) for m free positions
+// and value spread M by counting pairs per cost with zeta/Möbius transforms [van Rooij, Bodlaender,
+// Rossmanith - 10.1007/978-3-642-04128-0_51], or directly in O(3^m) when the spread is too large.
+// The transforms of a group take 8 bytes per level and state of the group, groups whose
+// transforms would take more than scratch_limit bytes are joined directly. Every chunk of groups
+// running at once has its own transforms.
+void join(const DPTable &l, const DPTable &r, DPTable &out, const StateSpace &space, int max_value, TaskPool *pool = nullptr, uint64_t scratch_limit = UINT64_MAX);
+
+}  // namespace DSHunter
+#endif  // DS_DP_KERNELS_H
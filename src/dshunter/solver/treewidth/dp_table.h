@@ -0,0 +1,122 @@
+#ifndef DS_DP_TABLE_H
+#define DS_DP_TABLE_H
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "table_storage.h"
+
+namespace DSHunter {
+
+// Table of DP values over the states of a bag.
+// Values are stored as offsets from a per-table base in the narrowest unsigned type that fits
+// them, the maximum of the type marking infeasible states. Values within a table are bounded by
+// the number of vertices forgotten below it, so most tables fit in one or two bytes per state.
+// Tables with a spill directory are kept in files mapped into memory.
+struct DPTable {
+    static constexpr int INF = 1'000'000'000;
+
+    template <class T>
+    static constexpr T SATURATED = std::numeric_limits<T>::max();
+
+    template <class T>
+    using Column = std::vector<T, TableAllocator<T>>;
+    using Values = std::variant<Column<uint8_t>, Column<uint16_t>, Column<uint32_t>>;
+
+    int base = 0;
+    // Upper bound on the finite offsets.
+    uint32_t max_offset = 0;
+    Values values;
+    // Directory of the files backing the table, or nullptr if it is kept on the heap.
+    const std::string *spill_dir = nullptr;
+
+    // Returns the number of bytes per state needed to store offsets up to max_offset.
+    static size_t widthFor(uint32_t max_offset) {
+        if (max_offset < SATURATED<uint8_t>)
+            return 1;
+        if (max_offset < SATURATED<uint16_t>)
+            return 2;
+        return 4;
+    }
+
+    [[nodiscard]] size_t width() const {
+        return std::visit([](const auto &v) { return sizeof(v[0]); }, values);
+    }
+
+    [[nodiscard]] size_t size() const {
+        return std::visit([](const auto &v) { return v.size(); }, values);
+    }
+
+    [[nodiscard]] bool empty() const { return size() == 0; }
+
+    // Releases the memory held by the table.
+    void clear() { values = Column<uint8_t>(); }
+
+    // Reallocates the table for size states in the narrowest type fitting new_max_offset,
+    // then calls f with the values as Column<T> &. The values are left uninitialized.
+    template <class F>
+    void reset(size_t size, int new_base, uint32_t new_max_offset, F &&f) {
+        base = new_base;
+        max_offset = new_max_offset;
+        switch (widthFor(max_offset)) {
+            case 1:
+                f(values.emplace<Column<uint8_t>>(size, TableAllocator<uint8_t>(spill_dir)));
+                break;
+            case 2:
+                f(values.emplace<Column<uint16_t>>(size, TableAllocator<uint16_t>(spill_dir)));
+                break;
+            default:
+                f(values.emplace<Column<uint32_t>>(size, TableAllocator<uint32_t>(spill_dir)));
+        }
+    }
+
+    // Returns the value of state f, or INF if it is infeasible.
+    [[nodiscard]] int get(size_t f) const {
+        return std::visit(
+            [&](const auto &v) {
+                using T = std::decay_t<decltype(v[0])>;
+                return v[f] == SATURATED<T> ? INF : base + static_cast<int>(v[f]);
+            },
+            values);
+    }
+
+    // Rebases the table on its smallest finite value and narrows its type if the spread allows it.
+    void normalize() {
+        uint32_t lo = SATURATED<uint32_t>, hi = 0;
+        std::visit(
+            [&](const auto &v) {
+                using T = std::decay_t<decltype(v[0])>;
+                for (T x : v) {
+                    if (x != SATURATED<T>) {
+                        lo = std::min<uint32_t>(lo, x);
+                        hi = std::max<uint32_t>(hi, x);
+                    }
+                }
+            },
+            values);
+
+        if (lo == SATURATED<uint32_t>)
+            lo = hi = 0;
+        if (lo == 0 && widthFor(hi) == width()) {
+            max_offset = hi;
+            return;
+        }
+
+        Values old = std::move(values);
+        reset(std::visit([](const auto &v) { return v.size(); }, old), base + static_cast<int>(lo), hi - lo, [&](auto &to) {
+            using TO = std::decay_t<decltype(to[0])>;
+            std::visit(
+                [&](const auto &from) {
+                    using TF = std::decay_t<decltype(from[0])>;
+                    for (size_t i = 0; i < from.size(); i++) to[i] = from[i] == SATURATED<TF> ? SATURATED<TO> : static_cast<TO>(from[i] - lo);
+                },
+                old);
+        });
+    }
+};
+
+}  // namespace DSHunter
+#endif  // DS_DP_TABLE_H
@@ -0,0 +1,133 @@
+#ifndef DS_STATE_SPACE_H
+#define DS_STATE_SPACE_H
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "../../utils.h"
+#include "ternary.h"
+
+namespace DSHunter {
+
+// Colors a vertex of a bag can take, which are always consecutive.
+struct Colors {
+    Color lowest;
+    uint8_t count;
+
+    // A dominated vertex needs no dominator, so it is never WHITE and its GRAY stands for both.
+    // A disregarded vertex is never taken, so it is never BLACK.
+    static Colors of(bool dominated, bool disregarded) {
+        const int lo = dominated ? 1 : 0, hi = disregarded ? 1 : 2;
+        return { static_cast<Color>(lo), static_cast<uint8_t>(hi - lo + 1) };
+    }
+
+    [[nodiscard]] bool has(Color c) const {
+        const int d = static_cast<int>(c) - static_cast<int>(lowest);
+        return d >= 0 && d < count;
+    }
+
+    // Returns the digit of c, assuming it is one of the colors.
+    [[nodiscard]] int digit(Color c) const { return static_cast<int>(c) - static_cast<int>(lowest); }
+
+    [[nodiscard]] Color color(int digit) const { return static_cast<Color>(static_cast<int>(lowest) + digit); }
+};
+
+__extension__ using uint128_t = unsigned __int128;
+
+// Multiplier and shift dividing states by a fixed number. The quotient is exact for all states
+// below 2^STATE_BITS [Granlund, Montgomery - 10.1145/178243.178249], as there are at most 3^22
+// of them. Digits are accessed on every state of the recovery and of Join groups, where the
+// integer divide was the most expensive instruction.
+struct Reciprocal {
+    static constexpr int STATE_BITS = 35;
+
+    uint64_t mul = 1;
+    int shift = 0;
+
+    Reciprocal() = default;
+
+    explicit Reciprocal(uint64_t d) {
+        int l = 0;
+        while ((uint64_t{ 1 } << l) < d) l++;
+        shift = STATE_BITS + l;
+        mul = static_cast<uint64_t>(((uint128_t{ 1 } << shift) + d - 1) / d);
+    }
+
+    [[nodiscard]] TernaryFun divide(TernaryFun f) const {
+        DS_ASSERT(f < (TernaryFun{ 1 } << STATE_BITS));
+        return static_cast<TernaryFun>(static_cast<uint128_t>(f) * mul >> shift);
+    }
+};
+
+// Mixed-radix encoding of the states of a bag, each position having a digit per color of its
+// vertex. With three colors everywhere the states are the ternary functions, while every dominated
+// or disregarded vertex shrinks the table by a third. The lowest digit is WHITE or a GRAY
+// dominated vertex, so state 0 is always the one with every vertex dominated.
+struct StateSpace {
+    std::vector<Colors> colors;
+    // stride[i] is the number of states of the positions below i, stride.back() of all of them.
+    std::vector<size_t> stride{ 1 };
+    // Divides by the stride of the same index.
+    std::vector<Reciprocal> reciprocal{ Reciprocal(1) };
+
+    StateSpace() = default;
+
+    explicit StateSpace(std::vector<Colors> position_colors) : colors(std::move(position_colors)) {
+        stride.resize(colors.size() + 1);
+        reciprocal.resize(colors.size() + 1);
+        for (size_t i = 0; i < colors.size(); i++) stride[i + 1] = stride[i] * colors[i].count;
+        for (size_t i = 0; i <= colors.size(); i++) reciprocal[i] = Reciprocal(stride[i]);
+    }
+
+    [[nodiscard]] int n_positions() const { return static_cast<int>(colors.size()); }
+
+    [[nodiscard]] size_t size() const { return stride.back(); }
+
+    // Returns the space with a vertex of the given colors inserted at position pos.
+    [[nodiscard]] StateSpace inserted(int pos, Colors c) const {
+        auto res = colors;
+        res.insert(res.begin() + pos, c);
+        return StateSpace(std::move(res));
+    }
+
+    // Returns the space with the vertices at the given increasing positions removed.
+    [[nodiscard]] StateSpace removed(const std::vector<int> &pos) const {
+        auto res = colors;
+        for (int i = static_cast<int>(pos.size()) - 1; i >= 0; i--) res.erase(res.begin() + pos[i]);
+        return StateSpace(std::move(res));
+    }
+
+    // The digit is the quotient by stride[pos] less the higher digits, so that no modulo is needed.
+    [[nodiscard]] int digit(TernaryFun f, int pos) const {
+        return static_cast<int>(reciprocal[pos].divide(f) - reciprocal[pos + 1].divide(f) * colors[pos].count);
+    }
+
+    [[nodiscard]] Color at(TernaryFun f, int pos) const { return colors[pos].color(digit(f, pos)); }
+
+    // Returns f with the vertex at pos recolored to c, which has to be one of its colors.
+    [[nodiscard]] TernaryFun set(TernaryFun f, int pos, Color c) const {
+        DS_ASSERT(colors[pos].has(c));
+        return f - digit(f, pos) * stride[pos] + colors[pos].digit(c) * stride[pos];
+    }
+
+    // Returns the state of the space without position pos matching f.
+    [[nodiscard]] TernaryFun cut(TernaryFun f, int pos) const {
+        return f - reciprocal[pos].divide(f) * stride[pos] + reciprocal[pos + 1].divide(f) * stride[pos];
+    }
+
+    [[nodiscard]] std::vector<Color> decode(TernaryFun f) const {
+        std::vector<Color> res(colors.size());
+        for (int i = 0; i < n_positions(); i++) res[i] = at(f, i);
+        return res;
+    }
+
+    [[nodiscard]] TernaryFun encode(const std::vector<Color> &c) const {
+        TernaryFun f = 0;
+        for (int i = 0; i < n_positions(); i++) f += colors[i].digit(c[i]) * stride[i];
+        return f;
+    }
+};
+
+}  // namespace DSHunter
+#endif  // DS_STATE_SPACE_H
@@ -0,0 +1,41 @@
+#include "table_storage.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+#include <vector>
+
+namespace DSHunter {
+
+void *mapFile(const std::string &dir, size_t bytes) {
+    std::string path = dir + "/dshunter-table-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    int fd = mkstemp(name.data());
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "cannot create table file in " + dir);
+    unlink(name.data());
+
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), "cannot resize table file in " + dir);
+    }
+
+    void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+    int error = errno;
+    // The mapping keeps the file alive.
+    close(fd);
+    if (p == MAP_FAILED)
+        throw std::system_error(error, std::generic_category(), "cannot map table file in " + dir);
+    return p;
+}
+
+void unmapFile(void *p, size_t bytes) {
+    munmap(p, bytes);
+}
+
+}  // namespace DSHunter
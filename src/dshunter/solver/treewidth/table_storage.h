@@ -0,0 +1,69 @@
+#ifndef DS_TABLE_STORAGE_H
+#define DS_TABLE_STORAGE_H
+#include <cstddef>
+#include <new>
+#include <string>
+#include <utility>
+
+namespace DSHunter {
+
+// Arrays smaller than this stay on the heap even if the table is spilled.
+constexpr size_t MIN_MAPPED_BYTES = size_t{ 1 } << 20;
+
+// Creates an anonymous file of the given size in dir and maps it into memory. The file is
+// unlinked right away, so it is removed once unmapped, even if the process dies.
+// Throws std::system_error if the file can't be created or mapped.
+void *mapFile(const std::string &dir, size_t bytes);
+
+void unmapFile(void *p, size_t bytes);
+
+// Allocator of DP table values. With a spill directory large arrays live in files mapped into
+// memory, so that the kernel can write them back to disk instead of the tables having to fit in
+// RAM. Elements are default-initialized, allocating a table doesn't touch its pages, as every
+// kernel writes all states of the tables it computes anyway.
+template <class T>
+struct TableAllocator {
+    using value_type = T;
+
+    // Directory of the backing files, or nullptr to allocate on the heap.
+    const std::string *spill_dir = nullptr;
+
+    TableAllocator() = default;
+    explicit TableAllocator(const std::string *spill_dir) : spill_dir(spill_dir) {}
+    template <class U>
+    TableAllocator(const TableAllocator<U> &other) : spill_dir(other.spill_dir) {}
+
+    T *allocate(size_t n) {
+        if (isMapped(n))
+            return static_cast<T *>(mapFile(*spill_dir, n * sizeof(T)));
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n) {
+        if (isMapped(n))
+            unmapFile(p, n * sizeof(T));
+        else
+            ::operator delete(p);
+    }
+
+    template <class U>
+    void construct(U *p) {
+        ::new (static_cast<void *>(p)) U;
+    }
+
+    template <class U, class... Args>
+    void construct(U *p, Args &&...args) {
+        ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+    }
+
+    template <class U>
+    bool operator==(const TableAllocator<U> &other) const {
+        return spill_dir == other.spill_dir;
+    }
+
+   private:
+    [[nodiscard]] bool isMapped(size_t n) const { return spill_dir != nullptr && n * sizeof(T) >= MIN_MAPPED_BYTES; }
+};
+
+}  // namespace DSHunter
+#endif  // DS_TABLE_STORAGE_H
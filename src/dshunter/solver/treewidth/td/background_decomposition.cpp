@@ -0,0 +1,77 @@
+#include "background_decomposition.h"
+
+#include <utility>
+
+namespace DSHunter {
+
+BackgroundDecomposition::BackgroundDecomposition(Decomposer &decomposer, const Instance &g, std::function<void(const TreeDecomposition &)> on_improvement)
+    : decomposer(decomposer),
+      g(g),
+      on_improvement(std::move(on_improvement)),
+      version(0),
+      returned_version(0),
+      done(false),
+      cancelled(false) {
+    decomposer.on_improvement = [this](const TreeDecomposition &td) { publish(td); };
+    decomposer.cancelled = &cancelled;
+    search = std::thread([this] {
+        std::optional<TreeDecomposition> td;
+        std::exception_ptr e;
+        try {
+            td = this->decomposer.decompose(this->g);
+        } catch (...) {
+            e = std::current_exception();
+        }
+        // Decomposers that don't report their decompositions as they go only return the last one.
+        if (td.has_value())
+            publish(*td);
+        std::lock_guard lock(m);
+        error = e;
+        done = true;
+        cv.notify_all();
+    });
+}
+
+BackgroundDecomposition::~BackgroundDecomposition() {
+    cancel();
+    search.join();
+    decomposer.on_improvement = nullptr;
+    decomposer.cancelled = nullptr;
+}
+
+void BackgroundDecomposition::publish(const TreeDecomposition &td) {
+    {
+        std::lock_guard lock(m);
+        if (!td.found() || (latest.has_value() && !td.isCheaperThan(*latest, g)))
+            return;
+        latest = td;
+        version++;
+        cv.notify_all();
+    }
+    if (on_improvement)
+        on_improvement(td);
+}
+
+std::optional<TreeDecomposition> BackgroundDecomposition::wait(const std::function<bool(const TreeDecomposition &)> &accept, std::chrono::milliseconds poll_interval) {
+    std::unique_lock lock(m);
+    while (true) {
+        if (error)
+            std::rethrow_exception(std::exchange(error, nullptr));
+        if (done || (latest.has_value() && version != returned_version && accept(*latest))) {
+            returned_version = version;
+            return latest;
+        }
+        cv.wait_for(lock, poll_interval);
+    }
+}
+
+bool BackgroundDecomposition::finished() {
+    std::lock_guard lock(m);
+    return done;
+}
+
+void BackgroundDecomposition::cancel() {
+    cancelled = true;
+}
+
+}  // namespace DSHunter
@@ -0,0 +1,60 @@
+#ifndef DS_BACKGROUND_DECOMPOSITION_H
+#define DS_BACKGROUND_DECOMPOSITION_H
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include "decomposer.h"
+
+namespace DSHunter {
+
+// Runs a decomposer on a thread of its own, keeping the cheapest decomposition it has found so
+// far, so that the caller can start working on one before the search is over.
+// The decomposer and the graph must outlive the search, which is cancelled by the destructor.
+struct BackgroundDecomposition {
+    // Starts the search. on_improvement, if set, is called with every decomposition cheaper than
+    // those before, from the searching threads, once it is the latest one.
+    BackgroundDecomposition(Decomposer &decomposer, const Instance &g, std::function<void(const TreeDecomposition &)> on_improvement = nullptr);
+    ~BackgroundDecomposition();
+
+    BackgroundDecomposition(const BackgroundDecomposition &) = delete;
+    BackgroundDecomposition &operator=(const BackgroundDecomposition &) = delete;
+
+    // Waits until the latest decomposition is one not returned before that accept agrees to, or
+    // until the search is over, and returns it. accept is called again every poll_interval, as it
+    // may depend on the time. Returns nullopt if the search ended without any decomposition.
+    std::optional<TreeDecomposition> wait(const std::function<bool(const TreeDecomposition &)> &accept, std::chrono::milliseconds poll_interval = std::chrono::milliseconds(50));
+
+    // Returns true once the decomposer has returned, then the latest decomposition is the best.
+    bool finished();
+
+    // Makes the decomposer return early. Decompositions found until then are still kept.
+    void cancel();
+
+   private:
+    Decomposer &decomposer;
+    const Instance &g;
+    std::function<void(const TreeDecomposition &)> on_improvement;
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::optional<TreeDecomposition> latest;
+    // Counts the decompositions published, to tell which one wait returned last.
+    uint64_t version, returned_version;
+    bool done;
+    std::exception_ptr error;
+
+    std::atomic<bool> cancelled;
+    std::thread search;
+
+    void publish(const TreeDecomposition &td);
+};
+
+}  // namespace DSHunter
+
+#endif  // DS_BACKGROUND_DECOMPOSITION_H
@@ -0,0 +1,236 @@
+#include "cached_decomposer.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "../../../utils.h"
+#include "../state_space.h"
+
+namespace DSHunter {
+namespace {
+
+// Returns the vertices of g in increasing order of ids, the numbering used in the cache.
+std::vector<int> canonicalOrder(const Instance& g) {
+    std::vector<int> order = g.nodes;
+    std::ranges::sort(order);
+    return order;
+}
+
+std::vector<int> ranksOf(const Instance& g, const std::vector<int>& order) {
+    std::vector<int> rank(g.all_nodes.size(), -1);
+    for (size_t i = 0; i < order.size(); i++) rank[order[i]] = static_cast<int>(i);
+    return rank;
+}
+
+// Returns true if td is a tree decomposition of g: its bags form a tree, hold every vertex at most
+// once and every edge, and the bags holding each vertex are connected. The cache may be shared by
+// other runs, other versions or be damaged, and a bag missing anything makes the DP wrong.
+bool isDecompositionOf(const Instance& g, const std::vector<int>& rank, const TreeDecomposition& td) {
+    const int n_bags = td.size();
+    std::vector<bool> reached(n_bags, false);
+    std::vector<int> stack{ 0 };
+    reached[0] = true;
+    int n_reached = 1;
+    while (!stack.empty()) {
+        const int t = stack.back();
+        stack.pop_back();
+        for (int s : td.adj[t]) {
+            if (!reached[s]) {
+                reached[s] = true;
+                n_reached++;
+                stack.push_back(s);
+            }
+        }
+    }
+    if (n_reached != n_bags)
+        return false;
+
+    // As the bags form a tree, those holding v are connected iff v is in both bags of one edge
+    // fewer than in bags.
+    std::vector<std::vector<int>> bags_of(g.all_nodes.size());
+    std::vector<int> last_bag(g.all_nodes.size(), -1);
+    for (int t = 0; t < n_bags; t++) {
+        for (int v : td.bag[t]) {
+            if (last_bag[v] == t)
+                return false;
+            last_bag[v] = t;
+            bags_of[v].push_back(t);
+        }
+    }
+    std::vector<int> shared_edges(g.all_nodes.size(), 0);
+    for (int t = 0; t < n_bags; t++) {
+        for (int v : td.bag[t]) last_bag[v] = t;
+        for (int s : td.adj[t]) {
+            if (s < t)
+                continue;
+            for (int v : td.bag[s]) shared_edges[v] += last_bag[v] == t;
+        }
+    }
+
+    std::vector<int> mark(g.all_nodes.size(), -1);
+    for (int v : g.nodes) {
+        if (bags_of[v].empty() || shared_edges[v] != static_cast<int>(bags_of[v].size()) - 1)
+            return false;
+        for (int t : bags_of[v]) {
+            for (int u : td.bag[t]) mark[u] = v;
+        }
+        for (int u : g[v].n_open) {
+            if (rank[u] >= 0 && mark[u] != v)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Reads a decomposition in the PACE .td format, with vertex i standing for order[i - 1].
+// Returns nullopt if the file is missing or doesn't describe a tree decomposition of g. The width
+// is that of the bags read, whatever the s-line says.
+std::optional<TreeDecomposition> readDecomposition(const std::string& path, const Instance& g, const std::vector<int>& order, const std::vector<int>& rank) {
+    std::ifstream in(path);
+    if (!in.is_open())
+        return std::nullopt;
+
+    TreeDecomposition td;
+    std::string line;
+    int n_bags = -1, n_vertices = 0, n_edges = 0;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == 'c')
+            continue;
+        std::istringstream lss(line);
+        if (n_bags < 0) {
+            char prefix;
+            std::string tag;
+            int width;
+            if (!(lss >> prefix >> tag >> n_bags >> width >> n_vertices) || prefix != 's' || tag != "td" || n_bags <= 0 || n_vertices != static_cast<int>(order.size())) {
+                DS_TRACE(std::cerr << "cachedDecompose: invalid s-line in " << path << ": " << line << std::endl);
+                return std::nullopt;
+            }
+            td.bag.assign(n_bags, {});
+            td.adj.assign(n_bags, {});
+        } else if (line[0] == 'b') {
+            char prefix;
+            int idx, v;
+            if (!(lss >> prefix >> idx) || idx < 1 || idx > n_bags)
+                return std::nullopt;
+            while (lss >> v) {
+                if (v < 1 || v > n_vertices)
+                    return std::nullopt;
+                td.bag[idx - 1].push_back(order[v - 1]);
+            }
+        } else {
+            int a, b;
+            if (!(lss >> a >> b) || a < 1 || b < 1 || a > n_bags || b > n_bags || a == b || std::ranges::find(td.adj[a - 1], b - 1) != td.adj[a - 1].end())
+                return std::nullopt;
+            td.addEdge(a - 1, b - 1);
+            n_edges++;
+        }
+    }
+
+    if (n_bags < 0 || n_edges != n_bags - 1 || !isDecompositionOf(g, rank, td)) {
+        DS_TRACE(std::cerr << "cachedDecompose: " << path << " is not a decomposition of the graph" << std::endl);
+        return std::nullopt;
+    }
+    td.width = 0;
+    for (const auto& b : td.bag) td.width = std::max(td.width, static_cast<int>(b.size()));
+    return td;
+}
+
+// Writes td in the PACE .td format, replacing the file at path only once it is complete, so that
+// runs sharing the cache never read a partial one.
+void writeDecomposition(const std::string& path, const TreeDecomposition& td, const std::vector<int>& rank, int n_vertices) {
+    const std::string tmp_path = path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream out(tmp_path);
+        if (!out.is_open()) {
+            DS_TRACE(std::cerr << "cachedDecompose: cannot write " << tmp_path << std::endl);
+            return;
+        }
+        out << "s td " << td.size() << " " << td.width << " " << n_vertices << "\n";
+        for (int i = 0; i < td.size(); i++) {
+            out << "b " << i + 1;
+            for (int v : td.bag[i]) out << " " << rank[v] + 1;
+            out << "\n";
+        }
+        for (int i = 0; i < td.size(); i++) {
+            for (int j : td.adj[i]) {
+                if (i < j)
+                    out << i + 1 << " " << j + 1 << "\n";
+            }
+        }
+        if (!out.good()) {
+            std::remove(tmp_path.c_str());
+            return;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+        std::remove(tmp_path.c_str());
+}
+
+}  // namespace
+
+CachedDecomposer::CachedDecomposer(const SolverConfig* cfg, std::unique_ptr<Decomposer> decomposer)
+    : Decomposer(cfg), decomposer(std::move(decomposer)) {}
+
+uint64_t CachedDecomposer::canonicalHash(const Instance& g) {
+    // FNV-1a over the number of vertices and the colors and sorted neighbourhood of each of them.
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&](int x) {
+        for (int i = 0; i < 4; i++) {
+            hash ^= static_cast<uint64_t>(x >> (8 * i) & 0xff);
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    const auto order = canonicalOrder(g);
+    const auto rank = ranksOf(g, order);
+    mix(static_cast<int>(order.size()));
+    std::vector<int> neighbours;
+    for (int v : order) {
+        mix(Colors::of(g.isDominated(v), g.isDisregarded(v)).count);
+        neighbours.clear();
+        for (int u : g[v].n_open) {
+            if (rank[u] >= 0)
+                neighbours.push_back(rank[u]);
+        }
+        std::ranges::sort(neighbours);
+        for (int u : neighbours) mix(u);
+        mix(-1);
+    }
+    return hash;
+}
+
+std::string CachedDecomposer::pathOf(const Instance& g) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.td", static_cast<unsigned long long>(canonicalHash(g)));
+    return cfg->decomposition_cache_directory + "/" + name;
+}
+
+std::optional<TreeDecomposition> CachedDecomposer::decompose(const Instance& input_graph) {
+    const std::string path = pathOf(input_graph);
+    const auto order = canonicalOrder(input_graph);
+    const auto rank = ranksOf(input_graph, order);
+    auto cached = readDecomposition(path, input_graph, order, rank);
+    if (cached.has_value() && cached->width <= cfg->good_enough_treewidth)
+        return cached;
+    if (cached.has_value() && on_improvement)
+        on_improvement(*cached);
+
+    decomposer->on_improvement = on_improvement;
+    decomposer->cancelled = cancelled;
+    std::optional<TreeDecomposition> td;
+    if (cached.has_value())
+        td = decomposer->improve(input_graph, *cached);
+    else
+        td = decomposer->decompose(input_graph);
+
+    if (td.has_value() && td->found() && (!cached.has_value() || td->isCheaperThan(*cached, input_graph)))
+        writeDecomposition(path, *td, rank, static_cast<int>(order.size()));
+    return td;
+}
+
+}  // namespace DSHunter
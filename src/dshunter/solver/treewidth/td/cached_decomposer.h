@@ -0,0 +1,34 @@
+#ifndef DS_CACHED_DECOMPOSER_H
+#define DS_CACHED_DECOMPOSER_H
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "decomposer.h"
+
+namespace DSHunter {
+
+// Keeps the best decomposition found for every graph in a .td file under
+// cfg->decomposition_cache_directory, named by a hash of the graph. Graphs are hashed with their
+// vertices numbered in increasing order of ids, so the same kernel of the same input always
+// finds its file, while isomorphic graphs labeled otherwise don't. The hash covers the number of
+// colors of each vertex as well, as the decompositions are ranked by the states of their bags.
+// A cached decomposition that is good enough is returned right away, any other one is handed to
+// the wrapped decomposer to beat.
+struct CachedDecomposer : Decomposer {
+    CachedDecomposer(const SolverConfig* cfg, std::unique_ptr<Decomposer> decomposer);
+    std::optional<TreeDecomposition> decompose(const Instance& input_graph) override;
+
+    // Returns the hash of the graph and the colors of its vertices, independent of the order of
+    // g.nodes.
+    static uint64_t canonicalHash(const Instance& g);
+
+   private:
+    std::unique_ptr<Decomposer> decomposer;
+
+    [[nodiscard]] std::string pathOf(const Instance& g) const;
+};
+
+}  // namespace DSHunter
+
+#endif  // DS_CACHED_DECOMPOSER_H
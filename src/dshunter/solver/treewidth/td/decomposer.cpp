@@ -5,4 +5,11 @@ Decomposer::Decomposer(const SolverConfig* cfg) : cfg(cfg) {}
 std::optional<TreeDecomposition> Decomposer::decompose(const Instance& input_graph) {
     return std::nullopt;
 }
+
+TreeDecomposition Decomposer::improve(const Instance& input_graph, TreeDecomposition known) {
+    auto td = decompose(input_graph);
+    if (!td.has_value() || !td->isCheaperThan(known, input_graph))
+        return known;
+    return std::move(*td);
+}
 }  // namespace DSHunter
\ No newline at end of file
@@ -1,5 +1,7 @@
 #ifndef DS_DECOMPOSER_H
 #define DS_DECOMPOSER_H
+#include <atomic>
+#include <functional>
 #include <optional>
 
 #include "../../solver.h"
@@ -9,14 +11,26 @@ namespace DSHunter {
 struct Decomposer {
     virtual ~Decomposer() = default;
     const SolverConfig* cfg;
+    // Called with every decomposition found that is cheaper than those before, from the threads
+    // searching for them, while decompose runs. Decomposers may only report their final result.
+    std::function<void(const TreeDecomposition&)> on_improvement;
+    // Makes decompose return early with the best decomposition so far once set, if not nullptr.
+    const std::atomic<bool>* cancelled = nullptr;
 
     explicit Decomposer(const SolverConfig* cfg);
 
+    [[nodiscard]] bool isCancelled() const { return cancelled != nullptr && *cancelled; }
+
     // Finds a tree decomposition with approximately low treewidth.
     // Returns the first decomposition that will have treewidth under treewidth_threshold.
     // Note that time_limit only tells when to stop looking for new solutions, so it might
     // terminate a lot later.
     virtual std::optional<TreeDecomposition> decompose(const Instance& input_graph);
+
+    // Same, but only looking for decompositions cheaper than known, one of input_graph found
+    // before, which is returned if none is found. By default the search runs as usual and the
+    // cheaper of the two decompositions is returned.
+    virtual TreeDecomposition improve(const Instance& input_graph, TreeDecomposition known);
 };
 
 }  // namespace DSHunter
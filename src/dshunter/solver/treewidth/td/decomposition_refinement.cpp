@@ -0,0 +1,340 @@
+#include "decomposition_refinement.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace DSHunter {
+namespace {
+
+// Torsos are handled as bitmasks, bags of more vertices are far beyond the DP anyway.
+constexpr int MAX_TORSO_SIZE = 64;
+
+// A split has to save at least this much weight, smaller differences are rounding errors.
+constexpr double WEIGHT_EPSILON = 1e-9;
+
+// How many bags are processed between two checks of the time.
+constexpr int TIME_CHECK_INTERVAL = 1 << 8;
+
+class Refinement {
+   public:
+    Refinement(const Instance &g, TreeDecomposition td, std::chrono::milliseconds time_limit)
+        : g(g), bag(std::move(td.bag)), adj(std::move(td.adj)), alive(bag.size(), true), deadline(std::chrono::steady_clock::now() + time_limit), checks(0) {
+        for (auto &b : bag) std::ranges::sort(b);
+    }
+
+    TreeDecomposition run() {
+        shrinkBags();
+        splitHeaviestBags();
+        shrinkBags();
+        return result();
+    }
+
+   private:
+    const Instance &g;
+    std::vector<std::vector<int>> bag;
+    std::vector<std::vector<int>> adj;
+    std::vector<bool> alive;
+    std::chrono::steady_clock::time_point deadline;
+    int checks;
+
+    bool outOfTime() {
+        if (++checks % TIME_CHECK_INTERVAL != 0)
+            return false;
+        return std::chrono::steady_clock::now() > deadline;
+    }
+
+    [[nodiscard]] bool contains(int b, int v) const { return std::ranges::binary_search(bag[b], v); }
+
+    [[nodiscard]] double weight(int b) const {
+        double res = 0;
+        for (int v : bag[b]) res += stateWeight(g, v);
+        return res;
+    }
+
+    // Merges bag a into its neighbour b, which takes over the other neighbours of a.
+    void contract(int a, int b) {
+        for (int c : adj[a]) {
+            if (c == b)
+                continue;
+            std::ranges::replace(adj[c], a, b);
+            adj[b].push_back(c);
+        }
+        std::erase(adj[b], a);
+        adj[a].clear();
+        bag[a].clear();
+        alive[a] = false;
+    }
+
+    // Drops vertices and merges bags until neither is possible anymore. A bag is looked at again
+    // when a neighbour loses a vertex or gets merged into it. Only bags with at most one other
+    // neighbour are merged, as merging the others adds joins to the larger bag.
+    void shrinkBags() {
+        std::vector<int> queue;
+        std::vector<bool> queued(bag.size(), false);
+        for (int b = 0; b < static_cast<int>(bag.size()); b++) {
+            if (alive[b]) {
+                queue.push_back(b);
+                queued[b] = true;
+            }
+        }
+        auto push = [&](int b) {
+            if (!queued[b]) {
+                queue.push_back(b);
+                queued[b] = true;
+            }
+        };
+
+        while (!queue.empty() && !outOfTime()) {
+            const int b = queue.back();
+            queue.pop_back();
+            queued[b] = false;
+            if (!alive[b])
+                continue;
+
+            for (size_t i = 0; i < bag[b].size();) {
+                const int v = bag[b][i];
+                if (dropVertex(b, v)) {
+                    for (int c : adj[b]) push(c);
+                } else {
+                    i++;
+                }
+            }
+
+            // A bag with more neighbours is where they are joined, on fewer states than in c.
+            if (adj[b].size() > 2)
+                continue;
+            for (int c : adj[b]) {
+                if (bag[b].size() <= bag[c].size() && std::ranges::includes(bag[c], bag[b])) {
+                    for (int d : adj[b]) push(d);
+                    contract(b, c);
+                    break;
+                }
+            }
+        }
+    }
+
+    // Drops v from bag b if b is a leaf of the subtree of v, and the only neighbour of b with v
+    // holds all neighbours of v in b. Every other bag with v lies past that neighbour, so it does
+    // not cover the edges of v that the neighbour doesn't.
+    bool dropVertex(int b, int v) {
+        int next = -1;
+        for (int c : adj[b]) {
+            if (contains(c, v)) {
+                if (next >= 0)
+                    return false;
+                next = c;
+            }
+        }
+        if (next < 0)
+            return false;
+        for (int u : bag[b]) {
+            if (u != v && g.hasEdge(u, v) && !contains(next, u))
+                return false;
+        }
+        bag[b].erase(std::ranges::lower_bound(bag[b], v));
+        return true;
+    }
+
+    // Tries to split the bags, heaviest first, until one can't be split or time runs out. Lighter
+    // bags matter less to the DP.
+    void splitHeaviestBags() {
+        std::vector<int> order;
+        std::vector<double> bag_weight(bag.size(), 0);
+        for (int b = 0; b < static_cast<int>(bag.size()); b++) {
+            if (alive[b]) {
+                order.push_back(b);
+                bag_weight[b] = weight(b);
+            }
+        }
+        std::ranges::sort(order, [&](int a, int b) { return bag_weight[a] > bag_weight[b]; });
+        for (int b : order) {
+            if (std::chrono::steady_clock::now() > deadline || static_cast<int>(bag[b].size()) > MAX_TORSO_SIZE || !splitBag(b, bag_weight[b]))
+                return;
+        }
+    }
+
+    // Replaces bag b by a min-fill decomposition of its torso, if all of its bags are lighter than
+    // b and the DP is predicted to take less time over them. Each neighbour of b then hangs below
+    // the first bag holding its separator, which is a clique of the torso.
+    bool splitBag(int b, double b_weight) {
+        // Copied, as the new bags are appended to bag.
+        const std::vector<int> vertices = bag[b];
+        const int k = static_cast<int>(vertices.size());
+        if (k <= 1)
+            return false;
+        auto index = [&](int v) { return static_cast<int>(std::ranges::lower_bound(vertices, v) - vertices.begin()); };
+
+        std::vector<uint64_t> torso(k, 0);
+        std::vector<double> w(k);
+        for (int i = 0; i < k; i++) {
+            w[i] = stateWeight(g, vertices[i]);
+            for (int u : g[vertices[i]].n_open) {
+                if (contains(b, u))
+                    torso[i] |= uint64_t{ 1 } << index(u);
+            }
+        }
+        std::vector<uint64_t> separator;
+        for (int c : adj[b]) {
+            uint64_t s = 0;
+            for (int v : bag[c]) {
+                if (contains(b, v))
+                    s |= uint64_t{ 1 } << index(v);
+            }
+            separator.push_back(s);
+            for (int i = 0; i < k; i++) {
+                if (s >> i & 1)
+                    torso[i] |= s & ~(uint64_t{ 1 } << i);
+            }
+        }
+        const uint64_t all = k == 64 ? ~uint64_t{ 0 } : (uint64_t{ 1 } << k) - 1;
+        bool clique = true;
+        for (int i = 0; i < k; i++) clique &= (torso[i] | uint64_t{ 1 } << i) == all;
+        if (clique)
+            return false;
+
+        // Eliminates the torso by weighted min-fill, each missing edge weighing its two ends.
+        std::vector<uint64_t> sub_bag;
+        std::vector<int> order, position(k);
+        uint64_t left = all;
+        while (left != 0) {
+            int best = -1;
+            double best_fill = 0;
+            for (uint64_t r = left; r != 0; r &= r - 1) {
+                const int v = std::countr_zero(r);
+                const uint64_t n = torso[v] & left;
+                double fill = 0;
+                for (uint64_t x = n; x != 0; x &= x - 1) {
+                    const int u = std::countr_zero(x);
+                    fill += w[u] * std::popcount(n & ~torso[u] & ~(uint64_t{ 1 } << u));
+                }
+                if (best < 0 || fill < best_fill) {
+                    best = v;
+                    best_fill = fill;
+                }
+            }
+            const uint64_t n = torso[best] & left;
+            double sub_weight = w[best];
+            for (uint64_t x = n; x != 0; x &= x - 1) sub_weight += w[std::countr_zero(x)];
+            if (sub_weight > b_weight - WEIGHT_EPSILON)
+                return false;
+            for (uint64_t x = n; x != 0; x &= x - 1) torso[std::countr_zero(x)] |= n & ~(uint64_t{ 1 } << std::countr_zero(x));
+            position[best] = static_cast<int>(sub_bag.size());
+            order.push_back(best);
+            sub_bag.push_back(n | uint64_t{ 1 } << best);
+            left &= ~(uint64_t{ 1 } << best);
+        }
+
+        // Sub-bag i hangs below the sub-bag of the first vertex eliminated after its own, those
+        // without one are chained.
+        const int m = static_cast<int>(sub_bag.size());
+        auto first = [&](uint64_t s) {
+            int res = m;
+            for (; s != 0; s &= s - 1) res = std::min(res, position[std::countr_zero(s)]);
+            return res;
+        };
+        std::vector<int> parent(m, -1), degree(m, 0);
+        for (int i = 0, last_root = -1; i < m; i++) {
+            const int p = first(sub_bag[i] & ~(uint64_t{ 1 } << order[i]));
+            if (p < m) {
+                parent[i] = p;
+            } else {
+                parent[i] = last_root;
+                last_root = i;
+            }
+            if (parent[i] >= 0) {
+                degree[i]++;
+                degree[parent[i]]++;
+            }
+        }
+        std::vector<int> attach;
+        for (uint64_t s : separator) {
+            const int p = first(s);
+            attach.push_back(p < m ? p : 0);
+            degree[attach.back()]++;
+        }
+
+        // The split has to lower the cost of the DP around b as well, counted as by dpCost.
+        auto log_states = [&](uint64_t s) {
+            double res = 0;
+            for (; s != 0; s &= s - 1) res += w[std::countr_zero(s)];
+            return res;
+        };
+        auto bag_cost = [](double log_s, int size, int degree) { return std::exp2(log_s) * (1 + std::max(0, degree - 2) * static_cast<double>(size)); };
+        auto edge_cost = [](double log_a, double log_b, int changed) { return changed * std::exp2(std::max(log_a, log_b)); };
+        double before = bag_cost(b_weight, k, static_cast<int>(adj[b].size())), after = 0;
+        for (int i = 0; i < m; i++) {
+            after += bag_cost(log_states(sub_bag[i]), std::popcount(sub_bag[i]), degree[i]);
+            if (parent[i] >= 0)
+                after += edge_cost(log_states(sub_bag[i]), log_states(sub_bag[parent[i]]), std::popcount(sub_bag[i] ^ sub_bag[parent[i]]));
+        }
+        for (size_t j = 0; j < separator.size(); j++) {
+            const int c = adj[b][j], size_c = static_cast<int>(bag[c].size());
+            const uint64_t at = sub_bag[attach[j]];
+            before += edge_cost(b_weight, weight(c), size_c + k - 2 * std::popcount(separator[j]));
+            after += edge_cost(log_states(at), weight(c), size_c + std::popcount(at) - 2 * std::popcount(separator[j] & at));
+        }
+        if (after >= before)
+            return false;
+
+        // Sub-bag 0 takes the place of b.
+        std::vector<int> id(m);
+        id[0] = b;
+        for (int i = 1; i < m; i++) {
+            id[i] = static_cast<int>(bag.size());
+            bag.emplace_back();
+            adj.emplace_back();
+            alive.push_back(true);
+        }
+        const std::vector<int> neighbours = std::move(adj[b]);
+        adj[b].clear();
+        for (int i = 0; i < m; i++) {
+            bag[id[i]].clear();
+            for (uint64_t x = sub_bag[i]; x != 0; x &= x - 1) bag[id[i]].push_back(vertices[std::countr_zero(x)]);
+            if (parent[i] >= 0) {
+                adj[id[i]].push_back(id[parent[i]]);
+                adj[id[parent[i]]].push_back(id[i]);
+            }
+        }
+        for (size_t j = 0; j < neighbours.size(); j++) {
+            const int c = neighbours[j], at = id[attach[j]];
+            std::ranges::replace(adj[c], b, at);
+            adj[at].push_back(c);
+        }
+        return true;
+    }
+
+    TreeDecomposition result() {
+        TreeDecomposition td;
+        std::vector<int> id(bag.size(), -1);
+        for (int b = 0; b < static_cast<int>(bag.size()); b++) {
+            if (alive[b]) {
+                id[b] = td.size();
+                td.bag.push_back(std::move(bag[b]));
+            }
+        }
+        td.adj.resize(td.size());
+        for (int b = 0; b < static_cast<int>(bag.size()); b++) {
+            if (!alive[b])
+                continue;
+            for (int c : adj[b]) td.adj[id[b]].push_back(id[c]);
+        }
+        td.width = 0;
+        for (const auto &b : td.bag) td.width = std::max(td.width, static_cast<int>(b.size()));
+        return td;
+    }
+};
+
+}  // namespace
+
+TreeDecomposition refineDecomposition(const Instance &g, TreeDecomposition td, std::chrono::milliseconds time_limit) {
+    if (td.size() <= 1)
+        return td;
+    // Each step makes bags smaller, but may still move a pass over a table to a larger one.
+    auto refined = Refinement(g, td, time_limit).run();
+    return td.isCheaperThan(refined, g) ? td : refined;
+}
+
+}  // namespace DSHunter
@@ -0,0 +1,23 @@
+#ifndef DS_DECOMPOSITION_REFINEMENT_H
+#define DS_DECOMPOSITION_REFINEMENT_H
+#include <chrono>
+
+#include "tree_decomposition.h"
+
+namespace DSHunter {
+
+// Returns td with redundant bags and vertices dropped and the heaviest bags split where possible,
+// a decomposition of g with bags no heavier than those of td:
+// - bags contained in a neighbour are merged into it, unless they join several others,
+// - a vertex is dropped from a bag at the end of its subtree when the next bag covers all its
+//   edges there, as in making the triangulation minimal,
+// - the heaviest bags are replaced by a decomposition of their torso, the graph of their vertices
+//   with the separators to their neighbours made cliques, when that one has lighter bags and is
+//   cheaper for the DP.
+// Gives up on what is left to do after time_limit, td stays valid at any point. td itself is
+// returned if the result is not cheaper after all.
+TreeDecomposition refineDecomposition(const Instance &g, TreeDecomposition td, std::chrono::milliseconds time_limit);
+
+}  // namespace DSHunter
+
+#endif  // DS_DECOMPOSITION_REFINEMENT_H
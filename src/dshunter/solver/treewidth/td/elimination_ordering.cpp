@@ -0,0 +1,267 @@
+#include "elimination_ordering.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace DSHunter {
+namespace {
+
+// Keys above this are all treated alike, vertices with that much fill are eliminated last anyway.
+constexpr uint64_t MAX_KEY = 1 << 20;
+
+// Vertex weights are kept in fixed point with this many units per bit of states, enough to tell
+// the vertices of two and three colors apart.
+constexpr double WEIGHT_SCALE = 8;
+
+// Min-fill recounts the fill of neighbours of an eliminated vertex right away up to this degree,
+// it is cheap for them and they are the likeliest to have become simplicial.
+constexpr int EAGER_FILL_DEGREE = 32;
+
+// How many vertices are eliminated between two calls of should_stop.
+constexpr int STOP_CHECK_INTERVAL = 1 << 10;
+
+// Vertices keyed by small integers, the one of the smallest key found in amortized constant time
+// as long as keys mostly go down. Entries are never moved, those of vertices whose key has
+// changed since are dropped when they come up.
+class BucketQueue {
+   public:
+    explicit BucketQueue(int n) : key(n, -1), lowest(0) {}
+
+    void set(int v, uint64_t k) {
+        const int b = static_cast<int>(std::min(k, MAX_KEY));
+        if (key[v] == b)
+            return;
+        key[v] = b;
+        if (b >= static_cast<int>(buckets.size()))
+            buckets.resize(b + 1);
+        buckets[b].push_back(v);
+        lowest = std::min(lowest, b);
+    }
+
+    void erase(int v) { key[v] = -1; }
+
+    // Returns a vertex of the smallest key, or -1 if there is none.
+    int top() {
+        for (; lowest < static_cast<int>(buckets.size()); lowest++) {
+            auto &bucket = buckets[lowest];
+            while (!bucket.empty()) {
+                if (key[bucket.back()] == lowest)
+                    return bucket.back();
+                bucket.pop_back();
+            }
+        }
+        return -1;
+    }
+
+   private:
+    std::vector<int> key;
+    std::vector<std::vector<int>> buckets;
+    int lowest;
+};
+
+// The graph left after eliminating some vertices, with the neighbourhood of each of them made a
+// clique. Vertices are numbered by their position in g.nodes, neighbourhoods are kept sorted.
+// Every vertex weighs its stateWeight, in fixed point.
+class EliminationGraph {
+   public:
+    explicit EliminationGraph(const Instance &g) : adj(g.nodeCount()), weight(g.nodeCount()), mark(g.nodeCount(), 0), stamp(0) {
+        std::vector<int> index(g.all_nodes.size(), -1);
+        for (int i = 0; i < g.nodeCount(); i++) index[g.nodes[i]] = i;
+        for (int i = 0; i < g.nodeCount(); i++) {
+            weight[i] = std::lround(stateWeight(g, g.nodes[i]) * WEIGHT_SCALE);
+            for (int u : g[g.nodes[i]].n_open) {
+                if (index[u] >= 0 && index[u] != i)
+                    adj[i].push_back(index[u]);
+            }
+            std::ranges::sort(adj[i]);
+            adj[i].erase(std::unique(adj[i].begin(), adj[i].end()), adj[i].end());
+        }
+    }
+
+    [[nodiscard]] int size() const { return static_cast<int>(adj.size()); }
+    [[nodiscard]] int deg(int v) const { return static_cast<int>(adj[v].size()); }
+    [[nodiscard]] uint64_t weightOf(int v) const { return weight[v]; }
+
+    // Returns the total weight of the neighbours of v.
+    [[nodiscard]] uint64_t weightOfNeighbours(int v) const {
+        uint64_t res = 0;
+        for (int u : adj[v]) res += weight[u];
+        return res;
+    }
+
+    // Returns the weight of the pairs of neighbours of v that are not adjacent, each pair weighing
+    // as much as its two vertices.
+    uint64_t fillIn(int v) {
+        const auto &n = adj[v];
+        stamp++;
+        for (int u : n) mark[u] = stamp;
+        uint64_t res = 0;
+        for (int u : n) {
+            uint64_t adjacent = 0;
+            for (int w : adj[u]) adjacent += mark[w] == stamp;
+            res += weight[u] * (n.size() - 1 - adjacent);
+        }
+        return res;
+    }
+
+    // Calls f with every common neighbour of u and v.
+    template <class F>
+    void forCommonNeighbours(int u, int v, const F &f) const {
+        auto a = adj[u].begin(), b = adj[v].begin();
+        while (a != adj[u].end() && b != adj[v].end()) {
+            if (*a < *b) {
+                ++a;
+            } else if (*b < *a) {
+                ++b;
+            } else {
+                f(*a);
+                ++a, ++b;
+            }
+        }
+    }
+
+    // Removes v, making its neighbours a clique, and returns them. The edges added between them
+    // are appended to fill_edges, if not nullptr.
+    std::vector<int> eliminate(int v, std::vector<std::pair<int, int>> *fill_edges) {
+        std::vector<int> n = std::move(adj[v]);
+        adj[v].clear();
+        std::vector<int> merged;
+        for (int u : n) {
+            auto &a = adj[u];
+            a.erase(std::ranges::lower_bound(a, v));
+            if (fill_edges != nullptr) {
+                auto b = a.begin();
+                for (int x : n) {
+                    while (b != a.end() && *b < x) ++b;
+                    if (u < x && (b == a.end() || *b != x))
+                        fill_edges->emplace_back(u, x);
+                }
+            }
+            merged.clear();
+            merged.reserve(a.size() + n.size());
+            std::ranges::set_union(a, n, std::back_inserter(merged));
+            merged.erase(std::ranges::lower_bound(merged, u));
+            a.swap(merged);
+        }
+        return n;
+    }
+
+   private:
+    std::vector<std::vector<int>> adj;
+    std::vector<uint64_t> weight;
+    std::vector<uint64_t> mark;
+    uint64_t stamp;
+};
+
+// Returns the decomposition of the elimination: bag i holds order[i] and the neighbours it had
+// then, all eliminated later, and hangs below the bag of the first of them. Bags of vertices
+// eliminated with no neighbours left end their components, these are chained together.
+TreeDecomposition decompositionOfElimination(const Instance &g, const std::vector<int> &order, std::vector<std::vector<int>> &bags) {
+    const int n = static_cast<int>(order.size());
+    std::vector<int> position(n);
+    for (int i = 0; i < n; i++) position[order[i]] = i;
+
+    TreeDecomposition td;
+    td.width = 0;
+    td.bag.resize(std::max(n, 1));
+    td.adj.resize(std::max(n, 1));
+    int last_root = -1;
+    for (int i = 0; i < n; i++) {
+        int parent = -1;
+        for (int u : bags[i]) {
+            if (parent < 0 || position[u] < parent)
+                parent = position[u];
+        }
+        if (parent >= 0) {
+            td.addEdge(i, parent);
+        } else {
+            if (last_root >= 0)
+                td.addEdge(i, last_root);
+            last_root = i;
+        }
+
+        td.bag[i].reserve(bags[i].size() + 1);
+        td.bag[i].push_back(g.nodes[order[i]]);
+        for (int u : bags[i]) td.bag[i].push_back(g.nodes[u]);
+        std::vector<int>().swap(bags[i]);
+        td.width = std::max(td.width, static_cast<int>(td.bag[i].size()));
+    }
+    return td;
+}
+
+}  // namespace
+
+// Min-fill counts the fill of a vertex lazily. Eliminating v makes the fill of every vertex go
+// down by the weight of each edge added between two of its neighbours. For the neighbours of v it
+// also goes down by the pairs of v and their other neighbours, and up by the pairs their new
+// neighbours make. Those of low degree are recounted right away, the others are keyed by the lower
+// bound without the latter and recounted once they come up in the queue, so that vertices of high
+// degree are rarely recounted.
+std::optional<TreeDecomposition> greedyDecomposition(const Instance &g, EliminationHeuristic heuristic, int max_bag_size, const std::function<bool()> &should_stop) {
+    EliminationGraph graph(g);
+    const int n = graph.size();
+    const bool min_fill = heuristic == EliminationHeuristic::MinFill;
+
+    BucketQueue queue(n);
+    std::vector<bool> dirty(n, min_fill);
+    std::vector<uint64_t> fill(n, 0);
+    std::vector<std::pair<int, int>> fill_edges;
+    auto bag_weight = [&](int v) { return graph.weightOf(v) + graph.weightOfNeighbours(v); };
+    for (int v = 0; v < n; v++) queue.set(v, min_fill ? 0 : bag_weight(v));
+
+    std::vector<int> order;
+    std::vector<std::vector<int>> bags;
+    order.reserve(n);
+    bags.reserve(n);
+    while (static_cast<int>(order.size()) < n) {
+        const int v = queue.top();
+        if (dirty[v]) {
+            dirty[v] = false;
+            fill[v] = graph.fillIn(v);
+            queue.set(v, fill[v]);
+            continue;
+        }
+        if (graph.deg(v) + 1 > max_bag_size)
+            return std::nullopt;
+        if (order.size() % STOP_CHECK_INTERVAL == 0 && should_stop && should_stop())
+            return std::nullopt;
+
+        queue.erase(v);
+        order.push_back(v);
+        fill_edges.clear();
+        bags.push_back(graph.eliminate(v, min_fill ? &fill_edges : nullptr));
+        const auto &neighbours = bags.back();
+        if (!min_fill) {
+            for (int u : neighbours) queue.set(u, bag_weight(u));
+            continue;
+        }
+
+        for (auto [x, y] : fill_edges) {
+            const uint64_t w_xy = graph.weightOf(x) + graph.weightOf(y);
+            graph.forCommonNeighbours(x, y, [&](int w) {
+                fill[w] -= std::min(fill[w], w_xy);
+                queue.set(w, fill[w]);
+            });
+        }
+        uint64_t clique_weight = 0;
+        for (int u : neighbours) clique_weight += graph.weightOf(u);
+        for (int u : neighbours) {
+            if (graph.deg(u) <= EAGER_FILL_DEGREE) {
+                fill[u] = graph.fillIn(u);
+            } else {
+                // The neighbours of u left outside of the clique used to miss their edge to v.
+                const uint64_t outside = graph.deg(u) + 1 - neighbours.size();
+                const uint64_t outside_weight = graph.weightOfNeighbours(u) + graph.weightOf(u) - clique_weight;
+                fill[u] -= std::min(fill[u], outside * graph.weightOf(v) + outside_weight);
+                dirty[u] = true;
+            }
+            queue.set(u, fill[u]);
+        }
+    }
+
+    return decompositionOfElimination(g, order, bags);
+}
+
+}  // namespace DSHunter
@@ -0,0 +1,30 @@
+#ifndef DS_ELIMINATION_ORDERING_H
+#define DS_ELIMINATION_ORDERING_H
+#include <functional>
+#include <limits>
+#include <optional>
+
+#include "tree_decomposition.h"
+
+namespace DSHunter {
+
+// Vertices are weighed by their stateWeight in g, so that the heuristics go for the bags of the
+// fewest states rather than the fewest vertices.
+enum class EliminationHeuristic {
+    // Eliminates a vertex of the lightest bag, itself and its neighbours left.
+    MinDegree,
+    // Eliminates a vertex whose neighbours left miss the lightest edges to form a clique, each
+    // weighing as much as its two ends.
+    MinFill
+};
+
+// Eliminates the vertices of g greedily by the heuristic, each time turning the neighbours of the
+// vertex into a clique, and returns the decomposition with a bag per vertex: the vertex and its
+// neighbours when it was eliminated.
+// Returns nullopt if some bag would have more than max_bag_size vertices, or once should_stop
+// returns true, which is checked every so often.
+std::optional<TreeDecomposition> greedyDecomposition(const Instance &g, EliminationHeuristic heuristic, int max_bag_size = std::numeric_limits<int>::max(), const std::function<bool()> &should_stop = nullptr);
+
+}  // namespace DSHunter
+
+#endif  // DS_ELIMINATION_ORDERING_H
@@ -1,41 +1,205 @@
 #include "exec_decomposer.h"
 
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <cerrno>
+#include <charconv>
+#include <chrono>
 #include <cstring>
 #include <optional>
-#include <sstream>
 #include <string>
-#include <thread>
+#include <string_view>
 #include <vector>
 
 #include "../../../utils.h"
 
 namespace DSHunter {
+namespace {
 
-// Attempts to run an external decomposer on input_graph within time_limit.
-// On success returns a filled TreeDecomposition, otherwise logs via DS_TRACE and returns nullopt.
-std::optional<TreeDecomposition> ExecDecomposer::decompose(const Instance& input_graph) {
-    int stdin_pipe[2];
-    int stdout_pipe[2];
-    if (pipe(stdin_pipe) == -1 || pipe(stdout_pipe) == -1) {
+// Decomposers still running once the time budget is over get this long to print their best
+// decomposition after SIGTERM, before they are killed.
+constexpr std::chrono::seconds TERMINATION_GRACE(5);
+
+// Bytes written to or read from a decomposer at a time.
+constexpr size_t CHUNK_SIZE = 1 << 16;
+
+// Returns input_graph in the PACE .gr format, vertices numbered by their position in nodes.
+std::string graphText(const Instance& input_graph) {
+    std::vector<int> rv(input_graph.all_nodes.size());
+    for (size_t i = 0; i < input_graph.nodes.size(); ++i) {
+        rv[input_graph.nodes[i]] = static_cast<int>(i);
+    }
+    std::string res = "p tw " + std::to_string(input_graph.nodeCount()) + " " + std::to_string(input_graph.edgeCount()) + "\n";
+    char buf[32];
+    auto append = [&](int x, char sep) {
+        auto end = std::to_chars(buf, buf + sizeof(buf), x).ptr;
+        *end++ = sep;
+        res.append(buf, end);
+    };
+    for (auto u : input_graph.nodes) {
+        for (auto v : input_graph[u].n_open) {
+            if (u > v)
+                continue;
+            append(rv[u] + 1, ' ');
+            append(rv[v] + 1, '\n');
+        }
+    }
+    return res;
+}
+
+// Parses a decomposition in the PACE .td format line by line, as the output of a decomposer
+// arrives. The decomposition is complete once all the bags and edges announced by the s-line
+// are read.
+struct TdParser {
+    const Instance& input_graph;
+    std::string partial_line;
+    TreeDecomposition td;
+    int n_bags = -1, n_bag_lines = 0, n_edges = 0;
+    bool failed = false;
+    // Integers of the line being parsed.
+    std::vector<int> values;
+
+    explicit TdParser(const Instance& input_graph) : input_graph(input_graph) {}
+
+    [[nodiscard]] bool complete() const {
+        return !failed && n_bags > 0 && n_bag_lines == n_bags && n_edges == n_bags - 1;
+    }
+
+    void feed(std::string_view data) {
+        while (!data.empty() && !failed && !complete()) {
+            const size_t eol = data.find('\n');
+            if (eol == std::string_view::npos) {
+                partial_line.append(data);
+                return;
+            }
+            partial_line.append(data.substr(0, eol));
+            data.remove_prefix(eol + 1);
+            parseLine(partial_line);
+            partial_line.clear();
+        }
+    }
+
+    // Called at the end of the output, which need not end with a newline.
+    void finish() {
+        if (!partial_line.empty() && !failed && !complete())
+            parseLine(partial_line);
+        partial_line.clear();
+    }
+
+   private:
+    // Reads the integers of line after its first skip characters into values, returning false
+    // if anything else is there.
+    static bool readInts(std::string_view line, size_t skip, std::vector<int>& values) {
+        values.clear();
+        const char *p = line.data() + std::min(skip, line.size()), *end = line.data() + line.size();
+        while (true) {
+            while (p != end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+            if (p == end)
+                return true;
+            int x;
+            auto [next, ec] = std::from_chars(p, end, x);
+            if (ec != std::errc())
+                return false;
+            values.push_back(x);
+            p = next;
+        }
+    }
+
+    void parseLine(std::string_view line) {
+        if (line.empty() || line[0] == 'c') {
+            if (!line.empty())
+                std::cerr << "execDecompose: " << line << std::endl;
+            return;
+        }
+        if (n_bags < 0) {
+            // s td <bags> <largest bag size> <vertices>
+            if (!line.starts_with("s td") || !readInts(line, 4, values) || values.size() != 3 || values[2] != input_graph.nodeCount()) {
+                DS_TRACE(std::cerr << "execDecompose: invalid or missing s-line: " << line << std::endl);
+                failed = true;
+                return;
+            }
+            n_bags = values[0];
+            if (n_bags <= 0) {
+                // No decomposition found
+                failed = true;
+                return;
+            }
+            td.width = values[1];
+            td.bag.assign(n_bags, {});
+            td.adj.assign(n_bags, {});
+        } else if (line[0] == 'b') {
+            if (!readInts(line, 1, values) || values.empty() || values[0] < 1 || values[0] > n_bags || n_bag_lines == n_bags) {
+                DS_TRACE(std::cerr << "execDecompose: invalid b-line: " << line << std::endl);
+                failed = true;
+                return;
+            }
+            auto& bag = td.bag[values[0] - 1];
+            for (size_t i = 1; i < values.size(); i++) {
+                if (values[i] < 1 || values[i] > input_graph.nodeCount()) {
+                    DS_TRACE(std::cerr << "execDecompose: invalid vertex in b-line: " << line << std::endl);
+                    failed = true;
+                    return;
+                }
+                bag.push_back(input_graph.nodes[values[i] - 1]);
+            }
+            n_bag_lines++;
+        } else {
+            if (!readInts(line, 0, values) || values.size() != 2 || values[0] < 1 || values[1] < 1 || values[0] > n_bags || values[1] > n_bags || n_edges == n_bags - 1) {
+                DS_TRACE(std::cerr << "execDecompose: invalid edge line: " << line << std::endl);
+                failed = true;
+                return;
+            }
+            td.addEdge(values[0] - 1, values[1] - 1);
+            n_edges++;
+        }
+    }
+};
+
+// A running decomposer, fed the graph through its stdin and read from its stdout.
+struct Child {
+    pid_t pid = -1;
+    int in_fd = -1, out_fd = -1;
+    size_t written = 0;
+    TdParser parser;
+
+    explicit Child(const Instance& input_graph) : parser(input_graph) {}
+};
+
+void closeFd(int& fd) {
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+}
+
+// Starts the executable at path with pipes to its stdin and stdout, stderr going to /dev/null.
+// The pipes are closed on exec, so that no decomposer holds those of another one.
+bool spawn(const std::string& path, Child& child) {
+    int stdin_pipe[2], stdout_pipe[2];
+    if (pipe2(stdin_pipe, O_CLOEXEC) == -1) {
         DS_TRACE(std::cerr << "execDecompose: pipe() failed: " << strerror(errno) << std::endl);
-        return std::nullopt;
+        return false;
+    }
+    if (pipe2(stdout_pipe, O_CLOEXEC) == -1) {
+        DS_TRACE(std::cerr << "execDecompose: pipe() failed: " << strerror(errno) << std::endl);
+        close(stdin_pipe[0]);
+        close(stdin_pipe[1]);
+        return false;
     }
 
-    pid_t pid = fork();
-    if (pid == -1) {
+    child.pid = fork();
+    if (child.pid == -1) {
         DS_TRACE(std::cerr << "execDecompose: fork() failed: " << strerror(errno) << std::endl);
-        return std::nullopt;
+        for (int fd : { stdin_pipe[0], stdin_pipe[1], stdout_pipe[0], stdout_pipe[1] }) close(fd);
+        return false;
     }
 
-    if (pid == 0) {
-        // Child: redirect stdin/stdout
+    if (child.pid == 0) {
+        // Child: redirect stdin/stdout, dup2 clears close-on-exec on them.
         dup2(stdin_pipe[0], STDIN_FILENO);
         dup2(stdout_pipe[1], STDOUT_FILENO);
         // Suppress stderr
@@ -44,134 +208,123 @@ std::optional<TreeDecomposition> ExecDecomposer::decompose(const Instance& input
             dup2(devnull, STDERR_FILENO);
             close(devnull);
         }
-        close(stdin_pipe[1]);
-        close(stdout_pipe[0]);
-        execl(cfg->decomposer_path.c_str(), cfg->decomposer_path.c_str(), static_cast<char*>(nullptr));
+        execl(path.c_str(), path.c_str(), static_cast<char*>(nullptr));
         _exit(1);
     }
 
-    // Parent: close unused ends
+    // Parent: close unused ends, the other ones never block.
     close(stdin_pipe[0]);
     close(stdout_pipe[1]);
+    child.in_fd = stdin_pipe[1];
+    child.out_fd = stdout_pipe[0];
+    fcntl(child.in_fd, F_SETFL, fcntl(child.in_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(child.out_fd, F_SETFL, fcntl(child.out_fd, F_GETFL) | O_NONBLOCK);
+    return true;
+}
 
-    // Feed input_graph in PACE .gr simple format
-    {
-        std::vector<int> rv(input_graph.all_nodes.size());
-        for (size_t i = 0; i < input_graph.nodes.size(); ++i) {
-            rv[input_graph.nodes[i]] = static_cast<int>(i);
-        }
-        std::ostringstream oss;
-        oss << "p tw " << input_graph.nodeCount() << " " << input_graph.edgeCount() << "\n";
-        for (auto u : input_graph.nodes) {
-            for (auto v: input_graph[u].n_open) {
-                if (u > v)
-                    continue;
-                oss << rv[u] + 1 << " " << rv[v] + 1 << "\n";
-            }
-        }
-        const std::string& data = oss.str();
-        if (write(stdin_pipe[1], data.data(), data.size()) == -1) {
-            DS_TRACE(std::cerr << "execDecompose: write() failed: " << strerror(errno) << std::endl);
-        }
-        close(stdin_pipe[1]);
+}  // namespace
+
+// Runs all decomposers of cfg->decomposer_paths at once on input_graph. The graph is written to
+// each of them from the same buffer while their outputs are parsed, all in a single poll loop.
+// The first decomposition within good_enough_treewidth is returned right away, the decomposers
+// still running are killed then. Otherwise the cheapest decomposition printed before the time
+// budget ends, or printed on SIGTERM after it, is returned.
+std::optional<TreeDecomposition> ExecDecomposer::decompose(const Instance& input_graph) {
+    // A decomposer exiting before reading the whole graph must not kill the solver.
+    signal(SIGPIPE, SIG_IGN);
+
+    const std::string graph = graphText(input_graph);
+    std::vector<Child> children;
+    children.reserve(cfg->decomposer_paths.size());
+    for (const auto& path : cfg->decomposer_paths) {
+        children.emplace_back(input_graph);
+        if (!spawn(path, children.back()))
+            children.pop_back();
     }
 
-    // Capture output
-    std::string output;
-    std::thread reader([&]() {
-        char buf[4096];
-        ssize_t n;
-        while ((n = read(stdout_pipe[0], buf, sizeof(buf))) > 0) {
-            output.append(buf, n);
+    std::optional<TreeDecomposition> best;
+    auto start = std::chrono::steady_clock::now();
+    std::optional<std::chrono::steady_clock::time_point> terminated;
+    std::vector<pollfd> fds;
+    std::vector<std::pair<Child*, bool>> fd_owner;  // child and whether the fd is its stdin
+    char buf[CHUNK_SIZE];
+
+    auto finishOutput = [&](Child& child) {
+        child.parser.finish();
+        closeFd(child.in_fd);
+        closeFd(child.out_fd);
+        if (!child.parser.complete())
+            return;
+        if (!best.has_value() || child.parser.td.isCheaperThan(*best, input_graph)) {
+            best = std::move(child.parser.td);
+            if (on_improvement)
+                on_improvement(*best);
         }
-    });
+    };
 
-    // Wait with timeout
-    auto start = std::chrono::steady_clock::now();
-    int status = 0;
     while (true) {
-        pid_t ret = waitpid(pid, &status, WNOHANG);
-        if (ret == pid || ret == -1) {
-            break;
+        fds.clear();
+        fd_owner.clear();
+        for (auto& child : children) {
+            if (child.in_fd >= 0) {
+                fds.push_back({ child.in_fd, POLLOUT, 0 });
+                fd_owner.emplace_back(&child, true);
+            }
+            if (child.out_fd >= 0) {
+                fds.push_back({ child.out_fd, POLLIN, 0 });
+                fd_owner.emplace_back(&child, false);
+            }
         }
-        if (std::chrono::steady_clock::now() - start > cfg->decomposition_time_budget) {
-            kill(pid, SIGTERM);
+        if (fds.empty() || (best.has_value() && best->width <= cfg->good_enough_treewidth))
             break;
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
 
-    reader.join();
-    close(stdout_pipe[0]);
-
-    // Parse .td output per Appendix B
-    TreeDecomposition td;
-    std::istringstream iss(output);
-    std::string line;
-    int N = 0, width_p1 = 0, num_vertices = 0;
-    bool header_found = false;
-    // Read solution line
-    while (std::getline(iss, line)) {
-        if (line.empty())
-            continue;
-        if (line[0] == 'c') {
-            std::cerr << "execDecompose: " << line << std::endl;
-            continue;
-        }
-        std::istringstream lss(line);
-        char prefix;
-        std::string tag;
-        if (!(lss >> prefix >> tag >> N >> width_p1 >> num_vertices) || prefix != 's' || tag != "td") {
-            DS_TRACE(std::cerr << "execDecompose: invalid or missing s-line: " << line << std::endl);
-            return std::nullopt;
-        }
-        if (N <= 0) {
-            // No decomposition found
-            return std::nullopt;
+        const auto now = std::chrono::steady_clock::now();
+        if (!terminated.has_value() && (isCancelled() || now - start > cfg->decomposition_time_budget)) {
+            for (auto& child : children) {
+                if (child.out_fd >= 0)
+                    kill(child.pid, SIGTERM);
+            }
+            terminated = now;
         }
-        td.width = width_p1;
-        if (td.width > 20) {
-            // width too large
-            return std::nullopt;
+        if (terminated.has_value() && (isCancelled() || now - *terminated > TERMINATION_GRACE))
+            break;
+
+        // Woken up regularly to check the time budget and cancellation.
+        if (poll(fds.data(), fds.size(), 100) == -1) {
+            if (errno == EINTR)
+                continue;
+            DS_TRACE(std::cerr << "execDecompose: poll() failed: " << strerror(errno) << std::endl);
+            break;
         }
-        header_found = true;
-        td.bag.assign(N, {});
-        td.adj.assign(N, {});
-        break;
-    }
-    if (!header_found) {
-        // No s-line at all: no decomposition
-        return std::nullopt;
-    }
-    // Read bags and edges
-    while (std::getline(iss, line)) {
-        if (line.empty() || line[0] == 'c')
-            continue;
-        std::istringstream lss(line);
-        char prefix;
-        lss >> prefix;
-        if (prefix == 'b') {
-            int idx;
-            if (!(lss >> idx) || idx < 1 || idx > N) {
-                DS_TRACE(std::cerr << "execDecompose: invalid b-line index: " << line << std::endl);
-                return std::nullopt;
-            }
-            std::vector<int> bag;
-            int v;
-            while (lss >> v) bag.push_back(input_graph.nodes[v - 1]);
-            td.bag[idx - 1] = std::move(bag);
-        } else {
-            int u, v;
-            std::istringstream ess(line);
-            if (!(ess >> u >> v) || u < 1 || v < 1 || u > N || v > N) {
-                DS_TRACE(std::cerr << "execDecompose: invalid edge line: " << line << std::endl);
-                return std::nullopt;
+
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (fds[i].revents == 0)
+                continue;
+            auto [child, is_stdin] = fd_owner[i];
+            if (is_stdin) {
+                const ssize_t n = write(child->in_fd, graph.data() + child->written, std::min(CHUNK_SIZE, graph.size() - child->written));
+                if (n > 0)
+                    child->written += n;
+                if ((n == -1 && errno != EAGAIN && errno != EINTR) || child->written == graph.size())
+                    closeFd(child->in_fd);
+            } else if (child->out_fd >= 0) {
+                const ssize_t n = read(child->out_fd, buf, sizeof(buf));
+                if (n > 0)
+                    child->parser.feed(std::string_view(buf, n));
+                if ((n == -1 && errno != EAGAIN && errno != EINTR) || n == 0 || child->parser.complete() || child->parser.failed)
+                    finishOutput(*child);
             }
-            td.addEdge(u - 1, v - 1);
         }
     }
 
-    return td;
+    // The decomposers that are done have closed their stdout or are about to exit anyway.
+    for (auto& child : children) {
+        closeFd(child.in_fd);
+        closeFd(child.out_fd);
+        kill(child.pid, SIGKILL);
+        waitpid(child.pid, nullptr, 0);
+    }
+    return best;
 }
 
 }  // namespace DSHunter
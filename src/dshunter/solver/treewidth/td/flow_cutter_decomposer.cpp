@@ -8,13 +8,19 @@
 #include <string.h>
 #include <sys/time.h>
 
+#include <atomic>
 #include <chrono>
+#include <functional>
 #include <limits>
 #include <map>
+#include <mutex>
 #include <queue>
+#include <random>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "elimination_ordering.h"
 #include "ext/flow-cutter-pace17/src/cell.h"
 #include "ext/flow-cutter-pace17/src/chain.h"
 #include "ext/flow-cutter-pace17/src/contraction_graph.h"
@@ -67,7 +73,61 @@ struct TransferGraph {
     }
 };
 
-ArrayIDIDFunc tail, head;
+// Graph handed to FlowCutter, numbered in preorder and with arcs sorted by tail, then by head.
+// Set up once by the constructor and only read afterwards, so the searches share it.
+struct PreparedGraph {
+    ArrayIDIDFunc tail, head;
+    ArrayIDIDFunc preorder, inv_preorder;
+    vector<int> reverse_mapping;
+
+    explicit PreparedGraph(TransferGraph g) : tail(std::move(g.g.tail)), head(std::move(g.g.head)), reverse_mapping(std::move(g.reverse_mapping)) {
+        {
+            preorder = compute_preorder(compute_successor_function(tail, head));
+            for (int i = 0; i < tail.image_count(); ++i) preorder[i] = i;
+            inv_preorder = inverse_permutation(preorder);
+            tail = chain(std::move(tail), inv_preorder);
+            head = chain(std::move(head), inv_preorder);
+        }
+
+        {
+            auto p = sort_arcs_first_by_tail_second_by_head(tail, head);
+            tail = chain(p, std::move(tail));
+            head = chain(p, std::move(head));
+        }
+    }
+};
+
+// Best decomposition of g found so far by any of the searches running in parallel, by the cost of
+// the DP over it.
+struct BestDecomposition {
+    const DSHunter::Instance& g;
+    std::mutex m;
+    DSHunter::TreeDecomposition td;
+    // Width of td, read without the lock to bound the partitioners.
+    std::atomic<int> width;
+    // Set once td is good enough, the time budget is over or the search is cancelled, the searches
+    // stop then.
+    std::atomic<bool> stop;
+    // Told about every decomposition that replaces td, under the lock, if set.
+    const std::function<void(const DSHunter::TreeDecomposition&)>& on_improvement;
+
+    BestDecomposition(const DSHunter::Instance& g, const std::function<void(const DSHunter::TreeDecomposition&)>& on_improvement)
+        : g(g), width(numeric_limits<int>::max()), stop(false), on_improvement(on_improvement) {
+        td.width = width;
+    }
+
+    void offer(DSHunter::TreeDecomposition decomposition, int good_enough_width) {
+        std::lock_guard lock(m);
+        if (width != numeric_limits<int>::max() && !decomposition.isCheaperThan(td, g))
+            return;
+        td = std::move(decomposition);
+        width = td.width;
+        if (td.width <= good_enough_width)
+            stop = true;
+        if (on_improvement)
+            on_improvement(td);
+    }
+};
 
 unsigned long long get_milli_time() {
     struct timeval tv;
@@ -121,8 +181,8 @@ void check_multilevel_partition_invariants(const Tail& tail, const Head& head, c
 #endif
 }
 
-template <class Tail, class Head, class ComputeSeparator, class OnNewMP>
-void compute_multilevel_partition(const Tail& tail, const Head& head, const ComputeSeparator& compute_separator, int smallest_known_treewidth, const OnNewMP& on_new_multilevel_partition) {
+template <class Tail, class Head, class ComputeSeparator, class ShouldStop, class OnNewMP>
+void compute_multilevel_partition(const Tail& tail, const Head& head, const ComputeSeparator& compute_separator, int smallest_known_treewidth, const ShouldStop& should_stop, const OnNewMP& on_new_multilevel_partition) {
     const int node_count = tail.image_count();
     const int arc_count = tail.preimage_count();
 
@@ -166,7 +226,7 @@ void compute_multilevel_partition(const Tail& tail, const Head& head, const Comp
     BitIDFunc in_child_cell(node_count);
     in_child_cell.fill(false);
 
-    while (!open_cells.empty()) {
+    while (!open_cells.empty() && !should_stop()) {
 #ifndef NDEBUG
 
         int real_max_closed_bag_size = 0;
@@ -311,8 +371,6 @@ void compute_multilevel_partition(const Tail& tail, const Head& head, const Comp
     }
 }
 
-ArrayIDIDFunc preorder, inv_preorder;
-
 DSHunter::TreeDecomposition make_tree_decompostion_of_multilevel_partition(
     const ArrayIDIDFunc& tail, const ArrayIDIDFunc& head, const ArrayIDIDFunc& to_input_node_id, const std::vector<Cell>& cell_list, const std::vector<int>& reverse_mapping) {
     DSHunter::TreeDecomposition td;
@@ -340,11 +398,11 @@ DSHunter::TreeDecomposition make_tree_decompostion_of_multilevel_partition(
 }
 
 DSHunter::TreeDecomposition multilevel_partition_as_tree_decomposition(
-    const std::vector<Cell>& cell_list, const vector<int>& reverse_mapping) {
-    return make_tree_decompostion_of_multilevel_partition(tail, head, preorder, cell_list, reverse_mapping);
+    const PreparedGraph& g, const std::vector<Cell>& cell_list) {
+    return make_tree_decompostion_of_multilevel_partition(g.tail, g.head, g.preorder, cell_list, g.reverse_mapping);
 }
 
-int compute_max_bag_size_of_order(const ArrayIDIDFunc& order) {
+int compute_max_bag_size_of_order(const ArrayIDIDFunc& tail, const ArrayIDIDFunc& head, const ArrayIDIDFunc& order) {
     auto inv_order = inverse_permutation(order);
     int current_tail = -1;
     int current_tail_up_deg = 0;
@@ -519,18 +577,19 @@ DSHunter::TreeDecomposition tree_decompostion_of_order(ArrayIDIDFunc tail, Array
     return td;
 }
 
-DSHunter::TreeDecomposition compute_decomposition_given_order(const ArrayIDIDFunc& order,
-                                                              const vector<int>& reverse_mapping) {
-    return tree_decompostion_of_order(tail, head, order, reverse_mapping);
+void test_new_order(const PreparedGraph& g, const ArrayIDIDFunc& order, BestDecomposition& best, int good_enough_width) {
+    int x = compute_max_bag_size_of_order(g.tail, g.head, order);
+    if (x <= best.width)
+        best.offer(tree_decompostion_of_order(g.tail, g.head, order, g.reverse_mapping), good_enough_width);
 }
 
-void test_new_order(const ArrayIDIDFunc& order, DSHunter::TreeDecomposition& bestDecomposition, const vector<int>& reverse_mapping) {
-    int x = compute_max_bag_size_of_order(order);
-    {
-        if (x < bestDecomposition.width) {
-            bestDecomposition = compute_decomposition_given_order(order, reverse_mapping);
-        }
-    }
+// Width bound passed to the partitioners. Partitions as wide as the best decomposition are still
+// reported, as they may be cheaper to solve.
+int width_bound_of(const BestDecomposition& best) {
+    const int width = best.width;
+    if (width == numeric_limits<int>::max())
+        return width;
+    return width + 1;
 }
 
 }  // namespace
@@ -538,35 +597,40 @@ void test_new_order(const ArrayIDIDFunc& order, DSHunter::TreeDecomposition& bes
 namespace DSHunter {
 
 // Finds a tree decomposition with approximately low treewidth.
-// Returns the first decomposition that will have treewidth under treewidth_threshold.
-// Note that time_limit only tells the FlowCutter to stop looking for new solutions, so it might
-// terminate a lot later.
+// The greedy orderings and FlowCutter's multilevel partitions with different seeds run in
+// parallel, on cfg->n_threads threads, all offering their decompositions to the same best one.
+// They stop once it is good enough, the time budget is over or the search is cancelled, FlowCutter
+// between two cells of a partition, which might be a lot later.
 std::optional<TreeDecomposition> FlowCutterDecomposer::decompose(const DSHunter::Instance& input_graph) {
-    TransferGraph g(input_graph);
-    DSHunter::TreeDecomposition best_decomposition;
-    best_decomposition.width = numeric_limits<int>::max();
-
-    tail = std::move(g.g.tail);
-    head = std::move(g.g.head);
-    auto start = std::chrono::high_resolution_clock::now();
+    auto td = search(input_graph, std::nullopt);
+    if (!td.found())
+        return std::nullopt;
+    return td;
+}
 
-    try {
-        {
-            preorder = compute_preorder(compute_successor_function(tail, head));
-            for (int i = 0; i < tail.image_count(); ++i) preorder[i] = i;
-            inv_preorder = inverse_permutation(preorder);
-            tail = chain(std::move(tail), inv_preorder);
-            head = chain(std::move(head), inv_preorder);
-        }
+TreeDecomposition FlowCutterDecomposer::improve(const Instance& input_graph, TreeDecomposition known) {
+    return search(input_graph, std::move(known));
+}
 
-        {
-            auto p = sort_arcs_first_by_tail_second_by_head(tail, head);
-            tail = chain(p, std::move(tail));
-            head = chain(p, std::move(head));
-        }
+TreeDecomposition FlowCutterDecomposer::search(const Instance& input_graph, std::optional<TreeDecomposition> known) {
+    const PreparedGraph g{ TransferGraph(input_graph) };
+    const int node_count = g.tail.image_count();
+    const int good_enough_width = cfg->good_enough_treewidth;
+    BestDecomposition best(input_graph, on_improvement);
+    if (known.has_value())
+        best.offer(std::move(*known), good_enough_width);
+    auto start = std::chrono::high_resolution_clock::now();
 
-        const int node_count = tail.image_count();
+    auto out_of_time = [&] {
+        return chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start) > cfg->decomposition_time_budget;
+    };
+    auto should_stop = [&] {
+        return best.stop || isCancelled();
+    };
 
+    // Runs partitions, a single one if once is set, until the searches stop or the time is over.
+    // next_config is called before each of them with its number.
+    auto run_flow_cutter = [&](flow_cutter::Config config, bool once, const std::function<void(flow_cutter::Config&, int)>& next_config) {
         long long last_print = 0;
 
         auto on_new_multilevel_partition = [&](const std::vector<Cell>& multilevel_partition,
@@ -577,80 +641,112 @@ std::optional<TreeDecomposition> FlowCutterDecomposer::decompose(const DSHunter:
                 return;
             last_print = now;
 
-            {
-                best_decomposition = multilevel_partition_as_tree_decomposition(
-                    multilevel_partition, g.reverse_mapping);
-            }
+            best.offer(multilevel_partition_as_tree_decomposition(g, multilevel_partition), good_enough_width);
         };
 
-        {
-            try {
-                std::minstd_rand rand_gen;
-                rand_gen.seed(cfg->random_seed);
-
-                if (node_count > 500000) {
-                    flow_cutter::Config config;
-                    config.cutter_count = 1;
-                    config.random_seed = rand_gen();
-                    config.min_small_side_size = 0.1;
-                    config.max_cut_size = 500;
-                    config.separator_selection =
-                        flow_cutter::Config::SeparatorSelection::edge_first;
-                    compute_multilevel_partition(tail, head, flow_cutter::ComputeSeparator(config), best_decomposition.width, on_new_multilevel_partition);
-                }
+        for (int i = 2; !best.stop; ++i) {
+            if (isCancelled() || (!once && out_of_time())) {
+                best.stop = true;
+                break;
+            }
+            next_config(config, i);
+            compute_multilevel_partition(g.tail, g.head, flow_cutter::ComputeSeparator(config), width_bound_of(best), should_stop, on_new_multilevel_partition);
+            if (once)
+                break;
+        }
+    };
 
-                if (node_count < 50000) {
-                    test_new_order(chain(compute_greedy_min_degree_order(tail, head), inv_preorder),
-                                   best_decomposition,
-                                   g.reverse_mapping);
-                }
+    std::vector<std::function<void()>> searches;
+
+    if (node_count > 500000) {
+        searches.emplace_back([&] {
+            std::minstd_rand rand_gen;
+            rand_gen.seed(cfg->random_seed);
+            flow_cutter::Config config;
+            config.cutter_count = 1;
+            config.min_small_side_size = 0.1;
+            config.max_cut_size = 500;
+            config.separator_selection =
+                flow_cutter::Config::SeparatorSelection::edge_first;
+            run_flow_cutter(config, true, [&](flow_cutter::Config& config, int) { config.random_seed = rand_gen(); });
+        });
+    }
 
-                if (node_count < 10000) {
-                    test_new_order(
-                        chain(compute_greedy_min_shortcut_order(tail, head), inv_preorder),
-                        best_decomposition,
-                        g.reverse_mapping);
-                }
+    if (node_count < 50000) {
+        searches.emplace_back([&] {
+            test_new_order(g, chain(compute_greedy_min_degree_order(g.tail, g.head), g.inv_preorder), best, good_enough_width);
+        });
+    }
 
-                {
-                    flow_cutter::Config config;
-                    config.cutter_count = 1;
-                    config.random_seed = rand_gen();
-                    config.max_cut_size = 10000;
-                    config.separator_selection =
-                        flow_cutter::Config::SeparatorSelection::node_min_expansion;
-
-                    for (int i = 2;
-                         chrono::duration_cast<chrono::milliseconds>(
-                             chrono::high_resolution_clock::now() - start) <= cfg->decomposition_time_budget &&
-                         best_decomposition.width > cfg->good_enough_treewidth;
-                         ++i) {
-                        config.random_seed = rand_gen();
-                        if (i % 16 == 0)
-                            ++config.cutter_count;
-
-                        switch (i % 3) {
-                            case 2:
-                                config.min_small_side_size = 0.2;
-                                break;
-                            case 1:
-                                config.min_small_side_size = 0.1;
-                                break;
-                            case 0:
-                                config.min_small_side_size = 0.0;
-                                break;
-                        }
+    if (node_count < 10000) {
+        searches.emplace_back([&] {
+            test_new_order(g, chain(compute_greedy_min_shortcut_order(g.tail, g.head), g.inv_preorder), best, good_enough_width);
+        });
+    }
 
-                        compute_multilevel_partition(
-                            tail, head, flow_cutter::ComputeSeparator(config), best_decomposition.width, on_new_multilevel_partition);
-                    }
+    // FlowCutter's greedy orderings are too slow for larger graphs, the native ones take over
+    // there. They give up once their bags get wider than the best decomposition.
+    auto run_greedy = [&](EliminationHeuristic heuristic) {
+        const int bound = width_bound_of(best);
+        auto td = greedyDecomposition(input_graph, heuristic, bound == numeric_limits<int>::max() ? bound : bound - 1, should_stop);
+        if (td.has_value())
+            best.offer(std::move(*td), good_enough_width);
+    };
+    if (node_count >= 50000)
+        searches.emplace_back([&] { run_greedy(EliminationHeuristic::MinDegree); });
+    if (node_count >= 10000)
+        searches.emplace_back([&] { run_greedy(EliminationHeuristic::MinFill); });
+
+    // Every thread runs a FlowCutter search of its own seed once the orderings are done.
+    const int n_threads = std::max(cfg->n_threads, 1);
+    for (int seed = 0; seed < n_threads; seed++) {
+        searches.emplace_back([&, seed] {
+            std::minstd_rand rand_gen;
+            rand_gen.seed(cfg->random_seed + seed);
+            flow_cutter::Config config;
+            config.cutter_count = 1;
+            config.max_cut_size = 10000;
+            config.separator_selection =
+                flow_cutter::Config::SeparatorSelection::node_min_expansion;
+
+            run_flow_cutter(config, false, [&](flow_cutter::Config& config, int i) {
+                config.random_seed = rand_gen();
+                if (i % 16 == 0)
+                    ++config.cutter_count;
+
+                switch (i % 3) {
+                    case 2:
+                        config.min_small_side_size = 0.2;
+                        break;
+                    case 1:
+                        config.min_small_side_size = 0.1;
+                        break;
+                    case 0:
+                        config.min_small_side_size = 0.0;
+                        break;
                 }
+            });
+        });
+    }
+
+    // A search that fails only ends itself, the others carry on.
+    std::atomic<size_t> next_search = 0;
+    auto work = [&] {
+        for (size_t i = next_search++; i < searches.size(); i = next_search++) {
+            if (should_stop())
+                return;
+            try {
+                searches[i]();
             } catch (...) {
             }
         }
-    } catch (...) {
-    }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < n_threads; i++) workers.emplace_back(work);
+    work();
+    for (auto& worker : workers) worker.join();
 
-    return best_decomposition;
+    return std::move(best.td);
 }
-}  // namespace DSHunter
\ No newline at end of file
+}  // namespace DSHunter
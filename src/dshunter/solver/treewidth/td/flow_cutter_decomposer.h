@@ -6,6 +6,11 @@ namespace DSHunter {
 struct FlowCutterDecomposer : Decomposer {
     using Decomposer::Decomposer;
     std::optional<TreeDecomposition> decompose(const Instance& input_graph) override;
+    // Bounds the partitioners by the width of known from the start.
+    TreeDecomposition improve(const Instance& input_graph, TreeDecomposition known) override;
+
+   private:
+    TreeDecomposition search(const Instance& input_graph, std::optional<TreeDecomposition> known);
 };
 }  // namespace DSHunter
 
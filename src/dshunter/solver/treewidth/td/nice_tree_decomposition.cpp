@@ -10,19 +10,20 @@
 namespace DSHunter {
 
 NiceTreeDecomposition::NiceTreeDecomposition() = default;
-NiceTreeDecomposition NiceTreeDecomposition::nicify(Instance g, TreeDecomposition td) {
-    auto rooted_decomposition = RootedTreeDecomposition(td);
+NiceTreeDecomposition NiceTreeDecomposition::nicify(Instance g, TreeDecomposition td, bool fused) {
+    auto rooted_decomposition = RootedTreeDecomposition(td, RootedTreeDecomposition::lowestPeakRoot(td, g));
     rooted_decomposition.sortBags();
     rooted_decomposition.equalizeJoinChildren();
-    rooted_decomposition.binarizeJoins();
+    rooted_decomposition.binarizeJoins(g);
     rooted_decomposition.forceEmptyRootAndLeaves();
 
-    return NiceTreeDecomposition(g, rooted_decomposition);
+    return NiceTreeDecomposition(g, rooted_decomposition, fused);
 }
 
 NiceTreeDecomposition::NiceTreeDecomposition(Instance g,
-                                             const RootedTreeDecomposition& rooted_decomposition)
-    : g(g) {
+                                             const RootedTreeDecomposition& rooted_decomposition,
+                                             bool fused)
+    : g(g), fused(fused) {
     root = makeDecompositionNodeFromRootedDecomposition(rooted_decomposition,
                                                         rooted_decomposition.root)
                .first;
@@ -80,10 +81,15 @@ void NiceTreeDecomposition::printDecomp(int v, int level) {
     auto& node = decomp[v];
     switch (node.type) {
         case NodeType::Forget:
-            vertex_label = "FORGET(" + std::to_string(node.v) + ")";
+            vertex_label = "FORGET(";
+            for (size_t i = 0; i < node.forgotten.size(); i++)
+                vertex_label += (i > 0 ? ", " : "") + std::to_string(node.forgotten[i]);
+            vertex_label += ")";
             break;
         case NodeType::IntroduceVertex:
-            vertex_label = "INTRODUCE_VERTEX(" + std::to_string(node.v) + ")";
+            vertex_label = "INTRODUCE_VERTEX(" + std::to_string(node.v);
+            for (auto to : node.edges_to) vertex_label += ", " + std::to_string(to);
+            vertex_label += ")";
             break;
         case NodeType::IntroduceEdge:
             vertex_label =
@@ -106,14 +112,16 @@ void NiceTreeDecomposition::printDecomp(int v, int level) {
             bag.erase(bag.begin() + node.pos_v);
         }
         if (node.type == NodeType::Forget) {
-            bag.insert(bag.begin() + node.pos_v, node.v);
+            for (size_t i = 0; i < node.forgotten.size(); i++)
+                bag.insert(bag.begin() + node.pos_forgotten[i], node.forgotten[i]);
         }
         printDecomp(node.l_child, level + 1);
         if (node.type == NodeType::IntroduceVertex) {
             bag.insert(bag.begin() + node.pos_v, node.v);
         }
         if (node.type == NodeType::Forget) {
-            bag.erase(bag.begin() + node.pos_v);
+            for (size_t i = node.forgotten.size(); i-- > 0;)
+                bag.erase(bag.begin() + node.pos_forgotten[i]);
         }
     }
     if (node.type == NodeType::Join)
@@ -155,12 +163,25 @@ int NiceTreeDecomposition::makeIntroduceForgetSequenceFrom(const std::vector<int
     // Construct the sequence bottom-up.
     auto to_forget = remove(tail_bag, intersection);
 
+    if (fused && !to_forget.empty()) {
+        // Positions in the bag before forgetting, increasing as both are sorted.
+        std::vector<int> pos_forgotten;
+        for (int forgotten : to_forget) pos_forgotten.push_back(std::ranges::lower_bound(tail_bag, forgotten) - tail_bag.begin());
+        tail_id = createNode(NodeType::Forget, intersection, NONE, NONE, tail_id);
+        decomp[tail_id].forgotten = to_forget;
+        decomp[tail_id].pos_forgotten = pos_forgotten;
+        tail_bag = intersection;
+        to_forget.clear();
+    }
+
     while (!to_forget.empty()) {
         int forgotten = to_forget.back();
         to_forget.pop_back();
         remove(tail_bag, forgotten);
         tail_id =
             createNode(NodeType::Forget, tail_bag, forgotten, NONE, tail_id);
+        decomp[tail_id].forgotten = { forgotten };
+        decomp[tail_id].pos_forgotten = { decomp[tail_id].pos_v };
     }
 
     DS_ASSERT(tail_bag == intersection);
@@ -175,6 +196,13 @@ int NiceTreeDecomposition::makeIntroduceForgetSequenceFrom(const std::vector<int
         insert(tail_bag, introduced);
         tail_id = createNode(NodeType::IntroduceVertex, tail_bag, introduced, NONE, tail_id);
 
+        if (fused) {
+            // Its edges within the bag come with it.
+            for (auto to : neighbours_in_bag) decomp[tail_id].pos_edges_to.push_back(std::ranges::lower_bound(tail_bag, to) - tail_bag.begin());
+            decomp[tail_id].edges_to = std::move(neighbours_in_bag);
+            continue;
+        }
+
         // Then introduce each edge within the bag.
         for (auto to : neighbours_in_bag) {
             tail_id = createNode(NodeType::IntroduceEdge, tail_bag, introduced, to, tail_id);
@@ -35,12 +35,24 @@ struct NiceTreeDecomposition {
         int r_child;
         int pos_v;   // Position of vertex v in this nodes' bag or in l_childs' bag in the case of a Forget node, -1 if unapplicable.
         int pos_to;  // Position of vertex to in this nodes' bag, -1 if unapplicable.
+
+        // Other endpoints of the edges introduced along with v by an IntroduceVertex node of a
+        // fused decomposition, and their positions in this nodes' bag.
+        std::vector<int> edges_to;
+        std::vector<int> pos_edges_to;
+        // Vertices forgotten by a Forget node, and their positions in l_childs' bag. There is one
+        // of them unless the decomposition is fused, then v and pos_v are -1.
+        std::vector<int> forgotten;
+        std::vector<int> pos_forgotten;
     };
 
     NiceTreeDecomposition();
 
+    // In a fused decomposition every IntroduceVertex node also introduces all edges of v to the
+    // bag, and consecutive Forget nodes are merged, there are no IntroduceEdge nodes. The DP then
+    // computes a single table where the nice decomposition needs one per edge and vertex.
     static NiceTreeDecomposition nicify(
-        Instance g, TreeDecomposition td);
+        Instance g, TreeDecomposition td, bool fused = false);
 
     const Node& operator[](int v) const;
     int root;
@@ -51,11 +63,12 @@ struct NiceTreeDecomposition {
 
    private:
     Instance g;
+    bool fused;
     std::vector<Node> decomp;
     static const int NONE = -1;
 
     // Assumes rooted_decomposition is already normalized!
-    NiceTreeDecomposition(Instance g, const RootedTreeDecomposition& rooted_decomposition);
+    NiceTreeDecomposition(Instance g, const RootedTreeDecomposition& rooted_decomposition, bool fused);
     int createNode(NodeType type, std::vector<int> bag = {}, int v = NONE, int to = NONE, int lChild = NONE, int rChild = NONE);
 
     std::vector<int> bag;
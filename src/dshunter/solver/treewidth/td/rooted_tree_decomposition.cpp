@@ -1,6 +1,71 @@
 #include "rooted_tree_decomposition.h"
 
+#include <array>
+#include <functional>
+
 #include "../../../utils.h"
+#include "../dp_table.h"
+#include "../state_space.h"
+
+namespace {
+
+// Bytes of the DP table of a bag of g, counted as planMemory does: a state per combination of
+// the colors of its vertices, in the width of values bounded by the number of vertices of g.
+double tableBytes(const DSHunter::Instance &g, const std::vector<int> &bag) {
+    double states = 1;
+    for (int v : bag) states *= DSHunter::Colors::of(g.isDominated(v), g.isDisregarded(v)).count;
+    return states * static_cast<double>(DSHunter::DPTable::widthFor(g.nodeCount())) + sizeof(DSHunter::DPTable);
+}
+
+// Peak of DP memory while computing a subtree, and the bytes of the table at its top that stay
+// held once it is computed.
+struct Peak {
+    double peak = 0;
+    double table = 0;
+
+    auto operator<=>(const Peak &other) const = default;
+};
+
+// Predicted peak of DP memory while computing a bag with a table of the given bytes from its
+// children. The child with the highest peak is computed first, every other one while the table
+// of the first is held, and joining holds three tables of the bag.
+Peak peakOf(double table, const Peak &first, const Peak &second, int n_children) {
+    if (n_children == 0)
+        return { table, table };
+    if (n_children == 1)
+        return { std::max(first.peak, 2 * table), table };
+    return { std::max({ first.peak, first.table + second.peak, 3 * table }), table };
+}
+
+// The three highest peaks among the neighbours of a bag, enough to drop any one of them.
+struct TopPeaks {
+    std::array<Peak, 3> top{};
+    int count = 0;
+
+    void add(Peak peak) {
+        count++;
+        for (auto &t : top) {
+            if (peak > t)
+                std::swap(peak, t);
+        }
+    }
+
+    [[nodiscard]] Peak peakWithout(double table, const Peak &excluded) const {
+        Peak first = top[0], second = top[1];
+        if (excluded == top[0]) {
+            first = top[1];
+            second = top[2];
+        } else if (excluded == top[1]) {
+            second = top[2];
+        }
+        return peakOf(table, first, second, count - 1);
+    }
+
+    [[nodiscard]] Peak peak(double table) const { return peakOf(table, top[0], top[1], count); }
+};
+
+}  // namespace
+
 namespace DSHunter {
 
 RootedTreeDecomposition::DecompositionNode &RootedTreeDecomposition::operator[](int v) {
@@ -11,8 +76,8 @@ const RootedTreeDecomposition::DecompositionNode &RootedTreeDecomposition::opera
     return decomp[v];
 }
 
-RootedTreeDecomposition::RootedTreeDecomposition(const TreeDecomposition &td)
-    : root(0), width(td.width), decomp(td.size()) {
+RootedTreeDecomposition::RootedTreeDecomposition(const TreeDecomposition &td, int root)
+    : root(root), width(td.width), decomp(td.size()) {
     if (td.size() > 0) {
         makeNodes(root, td, NONE);
         DS_ASSERT([&] {
@@ -31,6 +96,56 @@ RootedTreeDecomposition::RootedTreeDecomposition(const TreeDecomposition &td)
     }
 }
 
+int RootedTreeDecomposition::lowestPeakRoot(const TreeDecomposition &td, const Instance &g) {
+    const int n = td.size();
+    if (n == 0)
+        return 0;
+
+    std::vector<double> table(n);
+    for (int u = 0; u < n; u++) table[u] = tableBytes(g, td.bag[u]);
+
+    // Bags in BFS order from bag 0, parents before children.
+    std::vector<int> order = { 0 }, parent(n, NONE);
+    for (size_t i = 0; i < order.size(); i++) {
+        int u = order[i];
+        for (int v : td.adj[u]) {
+            if (v != parent[u]) {
+                parent[v] = u;
+                order.push_back(v);
+            }
+        }
+    }
+
+    // down[v] is the peak of the subtree of v when rooted at bag 0, up[v] the peak of the rest of
+    // the tree, rooted at the parent of v.
+    std::vector<Peak> down(n), up(n);
+    for (int i = n - 1; i >= 0; i--) {
+        int u = order[i];
+        TopPeaks peaks;
+        for (int v : td.adj[u]) {
+            if (v != parent[u])
+                peaks.add(down[v]);
+        }
+        down[u] = peaks.peak(table[u]);
+    }
+
+    int best_root = 0;
+    double best_peak = down[0].peak;
+    for (int u : order) {
+        TopPeaks peaks;
+        for (int v : td.adj[u]) peaks.add(v == parent[u] ? up[u] : down[v]);
+        for (int v : td.adj[u]) {
+            if (v != parent[u])
+                up[v] = peaks.peakWithout(table[u], down[v]);
+        }
+        if (peaks.peak(table[u]).peak < best_peak) {
+            best_peak = peaks.peak(table[u]).peak;
+            best_root = u;
+        }
+    }
+    return best_root;
+}
+
 void RootedTreeDecomposition::sortBags() {
     for (auto &node : decomp) {
         std::ranges::sort(node.bag);
@@ -44,7 +159,7 @@ void RootedTreeDecomposition::equalizeJoinChildren() { equalizeJoinChildren_(roo
 // Ensures each JOIN node has exactly two children.
 // Does so by inserting a new JOIN bag between a node with more than two children,
 // and any two children, reducing the degree by one each time until the tree is binary.
-void RootedTreeDecomposition::binarizeJoins() { binarizeJoins_(root); }
+void RootedTreeDecomposition::binarizeJoins(const Instance &g) { binarizeJoins_(root, g); }
 
 // Inserts an empty bag above the root and below all the leaves.
 void RootedTreeDecomposition::forceEmptyRootAndLeaves() {
@@ -99,22 +214,33 @@ void RootedTreeDecomposition::equalizeJoinChildren_(int node_id) {
     }
 }
 
-void RootedTreeDecomposition::binarizeJoins_(int node_id) {
+// Returns the predicted peak of DP memory while computing the subtree of node_id.
+double RootedTreeDecomposition::binarizeJoins_(int node_id, const Instance &g) {
+    std::vector<std::pair<Peak, int>> children;
     for (auto child : decomp[node_id].children) {
-        binarizeJoins_(child);
+        children.emplace_back(Peak{ binarizeJoins_(child, g), tableBytes(g, decomp[child].bag) }, child);
     }
+    std::ranges::sort(children, std::greater<>());
 
-    while (decomp[node_id].children.size() > 2) {
-        auto l = decomp[node_id].children.back();
-        decomp[node_id].children.pop_back();
-        auto r = decomp[node_id].children.back();
-        decomp[node_id].children.pop_back();
+    const double table = tableBytes(g, decomp[node_id].bag);
+    if (children.size() <= 2) {
+        decomp[node_id].children.clear();
+        for (auto [peak, child] : children) decomp[node_id].children.push_back(child);
+        return peakOf(table, children.empty() ? Peak{} : children[0].first, children.size() < 2 ? Peak{} : children[1].first, children.size()).peak;
+    }
 
-        auto intermediate_node = makeDecompositionNode(node_id, decomp[node_id].bag, { l, r });
-        decomp[l].parent_id = intermediate_node;
-        decomp[r].parent_id = intermediate_node;
-        decomp[node_id].children.push_back(intermediate_node);
+    // Join the children one by one to the result of the ones before them.
+    auto [joined_peak, joined] = children[0];
+    for (size_t i = 1; i + 1 < children.size(); i++) {
+        auto [peak, child] = children[i];
+        auto intermediate_node = makeDecompositionNode(node_id, decomp[node_id].bag, { joined, child });
+        decomp[joined].parent_id = intermediate_node;
+        decomp[child].parent_id = intermediate_node;
+        joined_peak = peakOf(table, joined_peak, peak, 2);
+        joined = intermediate_node;
     }
+    decomp[node_id].children = { joined, children.back().second };
+    return peakOf(table, joined_peak, children.back().first, 2).peak;
 }
 
 void RootedTreeDecomposition::insertEmptyBagsUnderLeaves(int node_id) {
@@ -31,7 +31,11 @@ struct RootedTreeDecomposition {
     DecompositionNode &operator[](int v);
     const DecompositionNode &operator[](int v) const;
 
-    explicit RootedTreeDecomposition(const TreeDecomposition &td);
+    explicit RootedTreeDecomposition(const TreeDecomposition &td, int root = 0);
+
+    // Returns the bag of td at which rooting it gives the lowest predicted peak of DP memory over
+    // g, with the children of every bag ordered as by binarizeJoins.
+    static int lowestPeakRoot(const TreeDecomposition &td, const Instance &g);
 
     RootedTreeDecomposition() = default;
 
@@ -41,9 +45,13 @@ struct RootedTreeDecomposition {
     // By inserting an additional bag between it and its children.
     void equalizeJoinChildren();
     // Ensures each JOIN node has exactly two children.
-    // Does so by inserting a new JOIN bag between a node with more than two children,
-    // and any two children, reducing the degree by one each time until the tree is binary.
-    void binarizeJoins();
+    // Does so by inserting new JOIN bags between a node with more than two children and its
+    // children, reducing the degree by one each time until the tree is binary. The children are
+    // ordered by the predicted peak of DP memory over g while computing them, decreasing, like
+    // registers in Sethi-Ullman numbering. The first child is computed first, and every
+    // other one is joined to the result of the ones before it. Tables take the bytes planMemory
+    // counts for them, the states of their bag times the width of their values.
+    void binarizeJoins(const Instance &g);
     // Inserts an empty bag above the root and below all the leaves.
     void forceEmptyRootAndLeaves();
 
@@ -54,7 +62,7 @@ struct RootedTreeDecomposition {
     void makeNodes(int u, const TreeDecomposition &td, int parent);
     int makeDecompositionNode(int parent_id, const std::vector<int>& bag, const std::vector<int>& children);
     void equalizeJoinChildren_(int node_id);
-    void binarizeJoins_(int node_id);
+    double binarizeJoins_(int node_id, const Instance &g);
     void insertEmptyBagsUnderLeaves(int node_id);
 };
 }  // namespace DSHunter
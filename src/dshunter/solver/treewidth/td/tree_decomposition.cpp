@@ -1,7 +1,22 @@
 #include "tree_decomposition.h"
 
+#include <cmath>
+#include <limits>
+
 #include "../../../utils.h"
+#include "../state_space.h"
 namespace DSHunter {
+namespace {
+
+// Weighted widths closer than this are the same, they differ only by the order of summation.
+constexpr double WIDTH_EPSILON = 1e-9;
+
+}  // namespace
+
+double stateWeight(const Instance &g, int v) {
+    return std::log2(Colors::of(g.isDominated(v), g.isDisregarded(v)).count);
+}
+
 int TreeDecomposition::size() const { return bag.size(); }
 
 void TreeDecomposition::print() const {
@@ -28,6 +43,55 @@ int TreeDecomposition::biggestBag() const {
     }
     return max_bag;
 }
+double TreeDecomposition::weightedWidth(const Instance &g) const {
+    double res = 0;
+    for (const auto &b : bag) {
+        double w = 0;
+        for (int v : b) w += stateWeight(g, v);
+        res = std::max(res, w);
+    }
+    return res;
+}
+
+double TreeDecomposition::dpCost(const Instance &g) const {
+    std::vector<std::vector<int>> sorted_bag = bag;
+    for (auto &b : sorted_bag) std::ranges::sort(b);
+    std::vector<double> log_states(size(), 0);
+    for (int i = 0; i < size(); i++) {
+        for (int v : bag[i]) log_states[i] += stateWeight(g, v);
+    }
+
+    double cost = 0;
+    for (int i = 0; i < size(); i++) {
+        const double states = std::exp2(log_states[i]);
+        // Rooted anywhere, all but at most two neighbours of a bag are children joined at it.
+        const int joins = std::max(0, static_cast<int>(adj[i].size()) - 2);
+        cost += states * (1 + joins * static_cast<double>(bag[i].size()));
+
+        for (int j : adj[i]) {
+            if (j < i)
+                continue;
+            const int common = intersect(sorted_bag[i], sorted_bag[j]).size();
+            const int changed = sorted_bag[i].size() + sorted_bag[j].size() - 2 * common;
+            cost += changed * std::exp2(std::max(log_states[i], log_states[j]));
+        }
+    }
+    return cost;
+}
+
+bool TreeDecomposition::found() const {
+    return !bag.empty() && width != std::numeric_limits<int>::max();
+}
+
+bool TreeDecomposition::isCheaperThan(const TreeDecomposition &other, const Instance &g) const {
+    if (!found() || !other.found())
+        return found();
+    const double w = weightedWidth(g), other_w = other.weightedWidth(g);
+    if (std::abs(w - other_w) > WIDTH_EPSILON)
+        return w < other_w;
+    return dpCost(g) < other.dpCost(g);
+}
+
 void TreeDecomposition::removeNode(int v) {
     for (int i = 0; i < size(); i++) {
         auto pos = std::ranges::find(bag[i], v);
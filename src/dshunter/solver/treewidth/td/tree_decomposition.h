@@ -19,9 +19,32 @@ struct TreeDecomposition {
     void print() const;
 
     [[nodiscard]] int biggestBag() const;
+
+    // Returns false for what a decomposer that found nothing returns, with no bags or a width of
+    // INT_MAX, which is no decomposition at all.
+    [[nodiscard]] bool found() const;
+
+    // Returns log2 of the number of states of the largest bag in the DP over g, the sum of the
+    // stateWeight of its vertices.
+    [[nodiscard]] double weightedWidth(const Instance &g) const;
+
+    // Predicted number of state operations of the dominating set DP over this decomposition of g.
+    // Every bag costs its states, 3 per vertex or fewer for dominated and disregarded ones, every
+    // vertex introduced or forgotten along an edge a pass over the larger of the two tables, and
+    // every join at a bag |bag| passes over its table.
+    [[nodiscard]] double dpCost(const Instance &g) const;
+
+    // Returns true if the DP over g is expected to run faster over this decomposition than over
+    // other, comparing the weighted widths first, as they bound the memory taken, then the costs.
+    // A decomposition not found is more expensive than any other.
+    [[nodiscard]] bool isCheaperThan(const TreeDecomposition &other, const Instance &g) const;
     void removeNode(int v);
 
     void addEdge(int a, int b);
 };
+
+// Weight of v in the objective of the decomposers: log2 of the number of colors it can take in the
+// DP, log2(3) unless it is dominated or disregarded.
+double stateWeight(const Instance &g, int v);
 }  // namespace DSHunter
 #endif  // DS_TREE_DECOMPOSITION_H
\ No newline at end of file
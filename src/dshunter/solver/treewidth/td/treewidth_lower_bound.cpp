@@ -0,0 +1,137 @@
+#include "treewidth_lower_bound.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <queue>
+#include <vector>
+
+namespace DSHunter {
+namespace {
+
+// How many vertices are removed or contracted between two calls of should_stop.
+constexpr int STOP_CHECK_INTERVAL = 1 << 10;
+
+// A minor of the graph, vertices numbered by their position in g.nodes, with the vertex of the
+// smallest degree at hand. Neighbourhoods are kept unsorted, so that contracting an edge only
+// costs the degrees of the vertices it touches.
+class MinorGraph {
+   public:
+    explicit MinorGraph(const Instance &g) : adj(g.nodeCount()), mark(g.nodeCount(), 0), stamp(0), dead(g.nodeCount(), false), n_alive(g.nodeCount()) {
+        std::vector<int> index(g.all_nodes.size(), -1);
+        for (int i = 0; i < g.nodeCount(); i++) index[g.nodes[i]] = i;
+        for (int i = 0; i < g.nodeCount(); i++) {
+            for (int u : g[g.nodes[i]].n_open) {
+                if (index[u] >= 0 && index[u] != i)
+                    adj[i].push_back(index[u]);
+            }
+            std::ranges::sort(adj[i]);
+            adj[i].erase(std::unique(adj[i].begin(), adj[i].end()), adj[i].end());
+            queue.emplace(deg(i), i);
+        }
+    }
+
+    [[nodiscard]] int size() const { return n_alive; }
+    [[nodiscard]] int deg(int v) const { return static_cast<int>(adj[v].size()); }
+
+    // Returns a vertex of the smallest degree left. Entries of the queue whose degree has
+    // changed since, or whose vertex is gone, are dropped as they come up.
+    int minDegreeVertex() {
+        while (true) {
+            auto [d, v] = queue.top();
+            if (adj[v].size() == static_cast<size_t>(d) && !dead[v])
+                return v;
+            queue.pop();
+        }
+    }
+
+    void remove(int v) {
+        for (int u : adj[v]) {
+            erase(u, v);
+            queue.emplace(deg(u), u);
+        }
+        adj[v].clear();
+        dead[v] = true;
+        n_alive--;
+    }
+
+    // Returns the neighbour of v that has the fewest neighbours in common with it.
+    int leastCommonNeighbour(int v) {
+        stamp++;
+        for (int u : adj[v]) mark[u] = stamp;
+        int best = -1, best_common = 0;
+        for (int u : adj[v]) {
+            int common = 0;
+            for (int w : adj[u]) common += mark[w] == stamp;
+            if (best < 0 || common < best_common) {
+                best = u;
+                best_common = common;
+            }
+        }
+        return best;
+    }
+
+    // Contracts the edge uv into u.
+    void contract(int v, int u) {
+        stamp++;
+        for (int w : adj[u]) mark[w] = stamp;
+        erase(u, v);
+        for (int w : adj[v]) {
+            if (w == u)
+                continue;
+            erase(w, v);
+            if (mark[w] != stamp) {
+                adj[w].push_back(u);
+                adj[u].push_back(w);
+            }
+            queue.emplace(deg(w), w);
+        }
+        queue.emplace(deg(u), u);
+        adj[v].clear();
+        dead[v] = true;
+        n_alive--;
+    }
+
+   private:
+    std::vector<std::vector<int>> adj;
+    std::vector<uint64_t> mark;
+    uint64_t stamp;
+    std::vector<bool> dead;
+    int n_alive;
+    std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<>> queue;
+
+    void erase(int u, int v) {
+        auto &a = adj[u];
+        auto it = std::ranges::find(a, v);
+        *it = a.back();
+        a.pop_back();
+    }
+};
+
+// Runs the minimum degree heuristic, contracting the vertex if contract is set and removing it
+// otherwise, and returns the largest minimum degree seen.
+int minimumDegreeBound(const Instance &g, bool contract, int target, const std::function<bool()> &should_stop) {
+    MinorGraph graph(g);
+    int bound = 0;
+    for (int step = 0; graph.size() > bound + 1 && bound < target; step++) {
+        if (step % STOP_CHECK_INTERVAL == 0 && should_stop && should_stop())
+            break;
+        const int v = graph.minDegreeVertex();
+        bound = std::max(bound, graph.deg(v));
+        if (contract && graph.deg(v) > 0)
+            graph.contract(v, graph.leastCommonNeighbour(v));
+        else
+            graph.remove(v);
+    }
+    return bound;
+}
+
+}  // namespace
+
+int treewidthLowerBound(const Instance &g, int target, const std::function<bool()> &should_stop) {
+    const int degeneracy = minimumDegreeBound(g, false, target, should_stop);
+    if (degeneracy >= target)
+        return degeneracy;
+    return std::max(degeneracy, minimumDegreeBound(g, true, target, should_stop));
+}
+
+}  // namespace DSHunter
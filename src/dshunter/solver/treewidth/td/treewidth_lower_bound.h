@@ -0,0 +1,21 @@
+#ifndef DS_TREEWIDTH_LOWER_BOUND_H
+#define DS_TREEWIDTH_LOWER_BOUND_H
+#include <functional>
+#include <limits>
+
+#include "../../../instance.h"
+
+namespace DSHunter {
+
+// Returns a lower bound on the treewidth of g, so every decomposition of g has a bag of more
+// vertices than that. The bound is the larger of the degeneracy of g, the largest smallest degree
+// seen while removing vertices of the smallest degree, and of a bound on its contraction
+// degeneracy, the same while contracting each of them into the neighbour they share the fewest
+// neighbours with instead, as minors of g have no larger treewidth.
+// Stops as soon as the bound reaches target, or once should_stop returns true, which is checked
+// every so often, and returns the bound found so far.
+int treewidthLowerBound(const Instance &g, int target = std::numeric_limits<int>::max(), const std::function<bool()> &should_stop = nullptr);
+
+}  // namespace DSHunter
+
+#endif  // DS_TREEWIDTH_LOWER_BOUND_H
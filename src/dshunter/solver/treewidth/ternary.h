@@ -1,10 +1,14 @@
 #ifndef TERNARY_H
 #define TERNARY_H
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
+#include "../../utils.h"
+
 namespace DSHunter {
 
-constexpr int MAX_EXPONENT = 18;
+constexpr int MAX_EXPONENT = 21;
 constexpr size_t pow3[MAX_EXPONENT + 1] = {
     1,
     3,
@@ -25,6 +29,9 @@ constexpr size_t pow3[MAX_EXPONENT + 1] = {
     43046721,
     129140163,
     387420489,
+    1162261467,
+    3486784401,
+    10460353203,
 };
 
 // e.g., WHITE = 0, GRAY = 0_dash, BLACK = 1 like in the platypus book.
@@ -36,21 +43,6 @@ enum class Color {
 
 using TernaryFun = size_t;
 
-// Removes xth argument of f from the domain.
-TernaryFun cut(TernaryFun f, int x);
-
-// Insert c at position x.
-TernaryFun insert(TernaryFun f, int x, Color c);
-
-// Set xth trit to c
-TernaryFun set(TernaryFun f, int x, Color c);
-
-// Set xth trit of f to c assuming it was zero before, we omit unnecessary division then.
-TernaryFun setUnset(TernaryFun f, int x, Color c);
-
-// Return the value of f's xth trit.
-Color at(TernaryFun f, int x);
-
 char val(Color c);
 TernaryFun toInt(std::string s);
 std::string toString(TernaryFun f);
@@ -1,69 +1,398 @@
 #include "treewidth_solver.h"
 
+#include <bit>
+#include <chrono>
+#include <cmath>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <utility>
 
 #include "../../utils.h"
+#include "../heuristic/greedy.h"
+#include "../memory_limit.h"
+#include "dp_kernels.h"
+#include "td/background_decomposition.h"
+#include "td/cached_decomposer.h"
+#include "td/decomposition_refinement.h"
 #include "td/exec_decomposer.h"
 #include "td/flow_cutter_decomposer.h"
+#include "td/treewidth_lower_bound.h"
 
 namespace {
 
 std::unique_ptr<DSHunter::Decomposer> getDecomposer(const DSHunter::SolverConfig *cfg) {
-    if (cfg->decomposer_path.empty())
-        return std::make_unique<DSHunter::FlowCutterDecomposer>(cfg);
-    return std::make_unique<DSHunter::ExecDecomposer>(cfg);
+    std::unique_ptr<DSHunter::Decomposer> decomposer;
+    if (cfg->decomposer_paths.empty())
+        decomposer = std::make_unique<DSHunter::FlowCutterDecomposer>(cfg);
+    else
+        decomposer = std::make_unique<DSHunter::ExecDecomposer>(cfg);
+    if (cfg->decomposition_cache_directory.empty())
+        return decomposer;
+    return std::make_unique<DSHunter::CachedDecomposer>(cfg, std::move(decomposer));
 }
 
-uint64_t getMemoryUsage(const DSHunter::NiceTreeDecomposition &td) {
-    uint64_t res = 0;
-    for (int i = 0; i < td.n_nodes(); i++) {
-        res += DSHunter::pow3[td[i].bag_size] * sizeof(int) + sizeof(std::vector<int>);
+// Returns the number of vertices forgotten in the subtree of each node, which bounds the values
+// of its table, relying on children having smaller ids than parents.
+std::vector<int> boundValues(const DSHunter::NiceTreeDecomposition &td) {
+    std::vector<int> max_value(td.n_nodes(), 0);
+    for (int t = 0; t < td.n_nodes(); t++) {
+        const auto &node = td[t];
+        if (node.type == DSHunter::NiceTreeDecomposition::NodeType::Forget)
+            max_value[t] += node.forgotten.size();
+        for (int child : { node.l_child, node.r_child }) {
+            if (child >= 0)
+                max_value[t] += max_value[child];
+        }
     }
+    return max_value;
+}
 
+// Lowers the bounds on values to what can still lead to a solution of at most incumbent vertices.
+// Vertices of the scattered set are pairwise at distance more than 2 and undominated, so each of
+// those outside the subtree of t and its bag needs its own dominator, none forgotten below t, nor
+// counted in the values of the table of t. Relies on children having smaller ids than parents.
+void pruneByIncumbent(const DSHunter::NiceTreeDecomposition &td, const std::vector<int> &scattered, int incumbent, std::vector<int> &max_value) {
+    using NodeType = DSHunter::NiceTreeDecomposition::NodeType;
+    std::vector<bool> is_scattered;
+    for (int v : scattered) {
+        if (static_cast<int>(is_scattered.size()) <= v)
+            is_scattered.resize(v + 1, false);
+        is_scattered[v] = true;
+    }
+    auto in_scattered = [&](int v) { return v >= 0 && v < static_cast<int>(is_scattered.size()) && is_scattered[v]; };
+
+    // Vertices of the scattered set forgotten below each node and in its bag.
+    std::vector<int> below(td.n_nodes(), 0), in_bag(td.n_nodes(), 0);
+    for (int t = 0; t < td.n_nodes(); t++) {
+        const auto &node = td[t];
+        if (node.l_child >= 0) {
+            below[t] = below[node.l_child];
+            in_bag[t] = in_bag[node.l_child];
+        }
+        if (node.type == NodeType::Join) {
+            below[t] += below[node.r_child];
+        } else if (node.type == NodeType::IntroduceVertex) {
+            in_bag[t] += in_scattered(node.v);
+        } else if (node.type == NodeType::Forget) {
+            for (int v : node.forgotten) {
+                below[t] += in_scattered(v);
+                in_bag[t] -= in_scattered(v);
+            }
+        }
+
+        const int outside = static_cast<int>(scattered.size()) - below[t] - in_bag[t];
+        max_value[t] = std::min(max_value[t], incumbent - outside);
+    }
+}
+
+// Returns the states of the bag of each node, relying on children having smaller ids than parents.
+std::vector<DSHunter::StateSpace> stateSpaces(const DSHunter::NiceTreeDecomposition &td, const DSHunter::Instance &g) {
+    using NodeType = DSHunter::NiceTreeDecomposition::NodeType;
+    std::vector<DSHunter::StateSpace> space(td.n_nodes());
+    for (int t = 0; t < td.n_nodes(); t++) {
+        const auto &node = td[t];
+        if (node.type == NodeType::IntroduceVertex)
+            space[t] = space[node.l_child].inserted(node.pos_v, DSHunter::Colors::of(g.isDominated(node.v), g.isDisregarded(node.v)));
+        else if (node.type == NodeType::Forget)
+            space[t] = space[node.l_child].removed(node.pos_forgotten);
+        else if (node.type != NodeType::Leaf)
+            space[t] = space[node.l_child];
+    }
+    return space;
+}
+
+// Returns the number of states of the largest bag of td, or anything above max_states if it is
+// bigger than that.
+size_t maxStates(const DSHunter::Instance &g, const DSHunter::TreeDecomposition &td, size_t max_states) {
+    size_t res = 0;
+    for (const auto &bag : td.bag) {
+        size_t states = 1;
+        for (size_t i = 0; i < bag.size() && states <= max_states; i++) states *= DSHunter::Colors::of(g.isDominated(bag[i]), g.isDisregarded(bag[i])).count;
+        res = std::max(res, states);
+    }
     return res;
 }
 
-constexpr int UNSET = -1, INF = 1'000'000'000;
+// Same, for the decomposition of the overlay, in which the vertices taken or ignored have a
+// single color.
+size_t maxStates(const DSHunter::BranchingOverlay &g, size_t max_states) {
+    size_t res = 0;
+    for (int i = 0; i < g.decomposition().size(); i++) {
+        size_t states = 1;
+        g.forEachInBag(i, [&](int v) {
+            if (states <= max_states)
+                states *= DSHunter::Colors::of(g.isDominated(v), g.isDisregarded(v)).count;
+        });
+        res = std::max(res, states);
+    }
+    return res;
+}
 
-}  // namespace
+// Returns the most vertices of three colors a bag may have for its table to be computed. Tables
+// of bags wider than max_treewidth only fit on disk. Bags are admitted by their number of states,
+// where dominated and disregarded vertices count for less than others.
+int maxWidth(const DSHunter::SolverConfig *cfg) {
+    return std::min(cfg->spill_directory.empty() ? cfg->max_treewidth : std::max(cfg->max_treewidth, DSHunter::MAX_EXPONENT), DSHunter::MAX_EXPONENT);
+}
 
-namespace DSHunter {
+// Returns the bytes per state of a table whose values are bounded by max_value. A negative bound
+// means that every state was pruned, the kernels then fill the table in the narrowest width.
+size_t valueWidth(int max_value) {
+    return DSHunter::DPTable::widthFor(static_cast<uint32_t>(std::max(max_value, 0)));
+}
 
-ExtendedInstance::ExtendedInstance(const Instance &instance, TreeDecomposition td) : Instance(instance), td(std::move(td)) {}
+// Returns the memory taken by each table, stored in the width needed for its bound on values.
+std::vector<uint64_t> tableSizes(const std::vector<DSHunter::StateSpace> &space, const std::vector<int> &max_value) {
+    std::vector<uint64_t> size(space.size());
+    for (size_t t = 0; t < space.size(); t++)
+        size[t] = space[t].size() * valueWidth(max_value[t]) + sizeof(DSHunter::DPTable);
+    return size;
+}
+
+// Subtrees with a smaller peak memory are not worth scheduling as a separate task.
+constexpr uint64_t MIN_PARALLEL_SUBTREE_BYTES = 1 << 16;
+
+// Smaller tables are not worth reading the resident memory of the process for.
+constexpr uint64_t MIN_CHECKED_TABLE_BYTES = 1 << 20;
+
+// Returns the peak memory usage of the sequential DP, given which tables are kept as checkpoints.
+// The forward pass is simulated exactly, relying on children having smaller ids than parents, and
+// peak[t] is set to the most memory held while computing the subtree of t.
+// Recovery starts with the tables left after the forward pass. Reaching a checkpoint, it
+// recomputes the region of tables down to the checkpoints below and keeps them until it reaches
+// them, so the regions of all checkpoints on the path to the node being recovered may be alive
+// at once, the right siblings left for later included.
+uint64_t estimatePeakMemory(const DSHunter::NiceTreeDecomposition &td, const std::vector<uint64_t> &table_size, const std::vector<bool> &checkpoint, std::vector<uint64_t> &peak) {
+    using NodeType = DSHunter::NiceTreeDecomposition::NodeType;
+    // live[t] is the memory held after computing the table of t.
+    std::vector<uint64_t> live(td.n_nodes());
+    peak.assign(td.n_nodes(), 0);
+    auto freed = [&](int t) { return checkpoint[t] ? 0 : table_size[t]; };
+    for (int t = 0; t < td.n_nodes(); t++) {
+        const auto &node = td[t];
+        uint64_t size = table_size[t];
+        if (node.type == NodeType::Leaf) {
+            live[t] = peak[t] = size;
+        } else if (node.type == NodeType::Join) {
+            int l = node.l_child, r = node.r_child;
+            peak[t] = std::max({ peak[l], live[l] + peak[r], live[l] + live[r] + size });
+            live[t] = live[l] + live[r] + size - freed(l) - freed(r);
+        } else {
+            int l = node.l_child;
+            peak[t] = std::max(peak[l], live[l] + size);
+            live[t] = live[l] + size - freed(l);
+        }
+    }
+
+    // region[t] is the memory of the tables recomputed below t when recovery reaches it.
+    std::vector<uint64_t> region(td.n_nodes(), 0);
+    for (int t = 0; t < td.n_nodes(); t++) {
+        for (int child : { td[t].l_child, td[t].r_child }) {
+            if (child >= 0 && !checkpoint[child])
+                region[t] += table_size[child] + region[child];
+        }
+    }
+    // pending[t] is the memory of the regions alive while recovering t, relying on parents having
+    // larger ids than children.
+    std::vector<uint64_t> pending(td.n_nodes(), 0);
+    pending[td.root] = region[td.root];
+    uint64_t recovery_peak = 0;
+    for (int t = td.n_nodes() - 1; t >= 0; t--) {
+        recovery_peak = std::max(recovery_peak, pending[t]);
+        for (int child : { td[t].l_child, td[t].r_child }) {
+            if (child >= 0)
+                pending[child] = pending[t] + (checkpoint[child] ? region[child] : 0);
+        }
+    }
+    return std::max(peak[td.root], live[td.root] + recovery_peak);
+}
 
-void ExtendedInstance::removeNode(int v) {
-    Instance::removeNode(v);
-    td.removeNode(v);
+// Marks the nodes at which the region of non-checkpoint tables below would exceed region_size.
+void placeCheckpoints(const DSHunter::NiceTreeDecomposition &td, const std::vector<uint64_t> &table_size, uint64_t region_size, std::vector<bool> &checkpoint) {
+    std::vector<uint64_t> region(td.n_nodes());
+    checkpoint.assign(td.n_nodes(), false);
+    for (int t = 0; t < td.n_nodes(); t++) {
+        const auto &node = td[t];
+        region[t] = table_size[t];
+        for (int child : { node.l_child, node.r_child }) {
+            if (child >= 0 && !checkpoint[child])
+                region[t] += region[child];
+        }
+        if (region[t] > region_size)
+            checkpoint[t] = true;
+    }
+    checkpoint[td.root] = true;
+}
+
+// Rough number of states the DP goes through per second on one thread, to weigh the predicted
+// cost of a decomposition against the time spent looking for it.
+constexpr double DP_STATES_PER_SECOND = 1e8;
+
+// A decomposition found while the DP runs replaces the one it runs on only if it is expected to
+// be solved this many times faster than what is left of the running DP.
+constexpr double RESTART_SPEEDUP = 2;
+
+// Every decomposition the DP runs on is refined first, for at most this share of the time budget
+// of the decomposition search.
+constexpr double REFINEMENT_TIME_SHARE = 0.01;
+
+// Share of the time budget of the decomposition search spent on the lower bound of the treewidth.
+constexpr double LOWER_BOUND_TIME_SHARE = 0.01;
+
+// Returns true if every decomposition of g has a bag of more than 3^max_width states, even in
+// every leaf of at most branch_depth levels of bag-branching, so that neither the DP nor
+// bag-branching can work. The leaves are held to the same number of states. Each level takes or
+// ignores at most two vertices, an ignored one taking its neighbours over forced edges with it,
+// and these leave the bags. The vertices left keep two colors in a leaf, as taking only dominates
+// them, unless they are disregarded, which are left out of the count.
+bool beyondDP(const DSHunter::Instance &g, int max_width, int branch_depth, std::chrono::milliseconds time_limit) {
+    std::vector<double> weight;
+    int max_forced = 0;
+    for (int v : g.nodes) {
+        weight.push_back(g.isDisregarded(v) ? 0 : branch_depth > 0 ? 1 : DSHunter::stateWeight(g, v));
+        int forced = 0;
+        for (auto [u, status] : g[v].adj) forced += status == DSHunter::EdgeStatus::FORCED && g.hasNode(u);
+        max_forced = std::max(max_forced, forced);
+    }
+    std::ranges::sort(weight);
+
+    // The fewest vertices left in a bag that have too many states, whichever they are.
+    const double max_log_states = max_width * std::log2(3.0);
+    double log_states = 0;
+    size_t left = 0;
+    while (left < weight.size() && log_states <= max_log_states) log_states += weight[left++];
+    if (log_states <= max_log_states)
+        return false;
+    const int64_t needed = static_cast<int64_t>(left) + static_cast<int64_t>(branch_depth) * (2 + max_forced);
+    if (needed > static_cast<int64_t>(g.nodeCount()))
+        return false;
+
+    const auto deadline = std::chrono::steady_clock::now() + time_limit;
+    const int tw = DSHunter::treewidthLowerBound(g, static_cast<int>(needed) - 1, [&] { return std::chrono::steady_clock::now() > deadline; });
+    return tw + 1 >= needed;
 }
 
-TreewidthSolver::TreewidthSolver(SolverConfig *cfg) : cfg(cfg), decomposer(getDecomposer(cfg)), solved_leaves(0), total_leaves(0) {}
+constexpr int INF = DSHunter::DPTable::INF;
+
+}  // namespace
+
+namespace DSHunter {
+
+TreewidthSolver::TreewidthSolver(SolverConfig *cfg)
+    : cfg(cfg),
+      decomposer(getDecomposer(cfg)),
+      incumbent(INF),
+      spare_memory(0),
+      memory_budget(cfg->max_memory_in_bytes),
+      cancelled(false),
+      stopped(false),
+      dp_cost(0),
+      states_done(0),
+      states_total(0),
+      pool(cfg->n_threads > 1 ? std::make_shared<TaskPool>(cfg->n_threads) : nullptr),
+      solved_leaves(0),
+      total_leaves(0),
+      best_size(SIZE_MAX) {}
+
+TreewidthSolver::TreewidthSolver(SolverConfig *cfg, std::shared_ptr<TaskPool> pool, uint64_t memory_budget)
+    : cfg(cfg),
+      incumbent(INF),
+      spare_memory(0),
+      memory_budget(memory_budget),
+      cancelled(false),
+      stopped(false),
+      dp_cost(0),
+      states_done(0),
+      states_total(0),
+      pool(std::move(pool)),
+      solved_leaves(0),
+      total_leaves(0),
+      best_size(SIZE_MAX) {}
 
 // Returns true if instance was solved. Solution set is stored in given instance.
 std::optional<std::vector<int>> TreewidthSolver::solve(const Instance &instance) {
-    auto td = decomposer->decompose(instance);
+    const int max_width = maxWidth(cfg);
+    auto fits = [&](const TreeDecomposition &td) { return td.found() && maxStates(instance, td, pow3[max_width]) <= pow3[max_width]; };
+    if (beyondDP(instance, max_width, cfg->max_bag_branch_depth, std::chrono::duration_cast<std::chrono::milliseconds>(cfg->decomposition_time_budget * LOWER_BOUND_TIME_SHARE))) {
+        // cfg->logLine("treewidth lower bound too high for the DP, even with bag-branching, skipping decomposition");
+        return std::nullopt;
+    }
+
+    // The DP starts before the search for decompositions is over on one that the final path below
+    // would solve directly as well, so one that fits and is not to be bag-branched on, if it is
+    // good enough or expected to be solved in no more time than the search has taken so far. The
+    // search goes on meanwhile, and the DP is restarted on a decomposition found that is much
+    // cheaper than what is left of it and that would be run directly too. If the DP fails, it
+    // waits for the next one.
+    auto runs_directly = [&](const TreeDecomposition &td) {
+        return fits(td) && (td.width <= cfg->good_enough_treewidth || cfg->max_bag_branch_depth == 0);
+    };
+    const auto start = std::chrono::steady_clock::now();
+    auto acceptable = [&](const TreeDecomposition &td) {
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return runs_directly(td) && (td.width <= cfg->good_enough_treewidth || td.dpCost(instance) <= seconds * DP_STATES_PER_SECOND);
+    };
+    const auto refinement_time = std::chrono::duration_cast<std::chrono::milliseconds>(cfg->decomposition_time_budget * REFINEMENT_TIME_SHARE);
+    // The decomposition the DP was cancelled for, which the search may have replaced by one that is
+    // not acceptable by the time the DP stops.
+    std::mutex restart_mutex;
+    std::optional<TreeDecomposition> restart_td;
+    BackgroundDecomposition search(*decomposer, instance, [&](const TreeDecomposition &td) {
+        if (runs_directly(td) && considerRestart(td.dpCost(instance))) {
+            std::lock_guard lock(restart_mutex);
+            restart_td = td;
+        }
+    });
+    auto next = [&] {
+        {
+            std::lock_guard lock(restart_mutex);
+            if (restart_td.has_value())
+                return std::exchange(restart_td, std::nullopt);
+        }
+        return search.wait(acceptable);
+    };
+    for (auto td = search.wait(acceptable); td.has_value() && !search.finished(); td = next()) {
+        auto refined = refineDecomposition(instance, *td, refinement_time);
+        if (runs_directly(refined))
+            *td = std::move(refined);
+        memory_budget = memoryLeft(cfg->max_memory_in_bytes);
+        cancelled = false;
+        states_done = states_total = 0;
+        dp_cost = td->dpCost(instance);
+        auto ds = solveDecomp(instance, *td);
+        dp_cost = 0;
+        if (ds.has_value())
+            return ds;
+        // cfg->logLine("found a much cheaper decomposition, restarting the DP");
+    }
+
+    // The search is over, so the latest decomposition is the best one.
+    cancelled = false;
+    auto td = search.wait(acceptable);
     if (!td.has_value()) {
         // cfg->logLine("decomposition failed");
         return std::nullopt;
     }
+    *td = refineDecomposition(instance, std::move(*td), refinement_time);
+    // The DP gets what the process doesn't hold yet, the instance and decomposition included.
+    memory_budget = memoryLeft(cfg->max_memory_in_bytes);
 
     // cfg->logLine("best found decomposition width: " + std::to_string(td->width));
     if (td->width > cfg->good_enough_treewidth) {
         // cfg->logLine(std::format("decomposition width > {}, considering reducing it with bag-branching of depth at most {}", cfg->good_enough_treewidth, cfg->max_bag_branch_depth));
-        auto e = ExtendedInstance(instance, *td);
-        auto [depth_needed, leaves] = estimateBranching(e);
+        BranchingOverlay overlay(instance, *td);
+        std::vector<BranchStep> path;
+        std::vector<std::vector<BranchStep>> plan;
+        auto [depth_needed, _] = estimateBranching(overlay, path, plan);
         if (depth_needed <= cfg->max_bag_branch_depth) {
             // cfg->logLine(std::format("bag-branching of depth at most {} is enough, proceeding with bag-branching", cfg->max_bag_branch_depth));
-            solved_leaves = 0;
-            total_leaves = leaves;
-            if (solveBranching(e))
-                return e.ds;
-            return std::nullopt;
+            return solveBranching(instance, *td, plan);
         }
         // cfg->logLine(std::format("bag-branching of depth at most {} is not enough, aborting bag-branching", cfg->max_bag_branch_depth));
     }
 
-    if (td->width <= cfg->max_treewidth) {
+    if (fits(*td)) {
         // cfg->logLine(std::format("tw = {} <= {}, attempting direct treewidth dp solution", td->width, cfg->max_treewidth));
         return solveDecomp(instance, *td);
     }
@@ -71,66 +400,193 @@ std::optional<std::vector<int>> TreewidthSolver::solve(const Instance &instance)
     return std::nullopt;
 }
 
-std::optional<std::vector<int>> TreewidthSolver::solveDecomp(const Instance &instance, const TreeDecomposition &raw_td) {
+std::optional<std::vector<int>> TreewidthSolver::solveDecomp(const Instance &instance, const TreeDecomposition &raw_td, size_t upper_bound) {
+    return solveDecomp(instance, std::make_shared<const NiceTreeDecomposition>(NiceTreeDecomposition::nicify(instance, raw_td, true)), upper_bound);
+}
+
+std::optional<std::vector<int>> TreewidthSolver::solveDecomp(const Instance &instance, std::shared_ptr<const NiceTreeDecomposition> nice_td, size_t upper_bound) {
     g = instance;
-    td = NiceTreeDecomposition::nicify(g, raw_td);
-    // cfg->logLine(std::format("solving td({})", td.width()));
-    if (getMemoryUsage(td) > cfg->max_memory_in_bytes) {
-        // cfg->logLine(std::format("needed {} MB, aborting ", getMemoryUsage(td) / 1024 / 1024));
+    td = std::move(nice_td);
+    space = stateSpaces(*td, g);
+    states_total = std::accumulate(space.begin(), space.end(), uint64_t{ 0 }, [](uint64_t sum, const StateSpace &s) { return sum + s.size(); });
+    // cfg->logLine(std::format("solving td({})", td->width()));
+    max_value = boundValues(*td);
+    // The greedy solution is the incumbent, unless the caller knows a better one, states that
+    // can't beat it are pruned.
+    const int n_taken = g.ds.size();
+    auto greedy = greedyDominatingSet(g);
+    incumbent = static_cast<int>(std::min(greedy.size(), upper_bound)) - n_taken;
+    const auto scattered = maximalScatteredSet(g, 3);
+    pruneByIncumbent(*td, std::vector(scattered.begin() + n_taken, scattered.end()), incumbent, max_value);
+    if (!planMemory()) {
+        // cfg->logLine(std::format("no checkpoint placement fits in {} MB, aborting ", cfg->max_memory_in_bytes / 1024 / 1024));
         return std::nullopt;
     }
 
-    c = std::vector(td.n_nodes(), std::vector<int>());
+    c = std::vector(td->n_nodes(), DPTable());
+    stopped = false;
 
-    getC(td.root, 0);
-    recoverDS(td.root, 0);
+    computeTable(td->root, false);
+    if (!stopped && c[td->root].get(0) >= INF) {
+        // Everything was pruned, so no solution is within the caller's bound.
+        return greedy;
+    }
+    if (!stopped)
+        recoverDS(td->root, 0);
+    if (stopped) {
+        // cfg->logLine(std::format("DP would go over {} MB or was cancelled, aborting", cfg->max_memory_in_bytes / 1024 / 1024));
+        c.clear();
+        return std::nullopt;
+    }
     // cfg->logLine(std::format("found solution of size {}", g.ds.size()));
     return g.ds;
 }
 
-std::pair<int, int> TreewidthSolver::getWidthAndSplitter(const ExtendedInstance &instance) const {
-    auto &td = instance.td;
-    int biggest_bag = td.biggestBag();
+bool TreewidthSolver::planMemory() {
+    auto table_size = tableSizes(space, max_value);
+    on_disk.assign(td->n_nodes(), false);
+    if (planCheckpoints(table_size))
+        return true;
+    if (cfg->spill_directory.empty())
+        return false;
+
+    // Spill the largest tables first, they are the ones streamed through in long runs. Tables
+    // of the same size go together, so that the plan is redone once per bag size.
+    std::vector<int> order(td->n_nodes());
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::sort(order, [&](int a, int b) { return table_size[a] > table_size[b]; });
+    for (size_t i = 0; i < order.size() && table_size[order[i]] >= MIN_MAPPED_BYTES;) {
+        const uint64_t size = table_size[order[i]];
+        for (; i < order.size() && table_size[order[i]] == size; i++) {
+            on_disk[order[i]] = true;
+            table_size[order[i]] = sizeof(DPTable);
+        }
+        if (planCheckpoints(table_size))
+            return true;
+    }
+    return false;
+}
+
+bool TreewidthSolver::planCheckpoints(const std::vector<uint64_t> &table_size) {
+    checkpoint.assign(td->n_nodes(), true);
+    uint64_t total = estimatePeakMemory(*td, table_size, checkpoint, subtree_peak);
+    if (total <= memory_budget) {
+        spare_memory = memory_budget - total;
+        return true;
+    }
+
+    uint64_t largest_table = std::ranges::max(table_size);
+
+    // Smaller regions mean more checkpoints, bigger ones mean more tables alive during recovery.
+    uint64_t best_peak = total, best_region_size = 0;
+    for (uint64_t region_size = largest_table; region_size < total; region_size *= 2) {
+        placeCheckpoints(*td, table_size, region_size, checkpoint);
+        uint64_t peak = estimatePeakMemory(*td, table_size, checkpoint, subtree_peak);
+        if (peak < best_peak) {
+            best_peak = peak;
+            best_region_size = region_size;
+        }
+    }
+
+    if (best_peak > memory_budget)
+        return false;
+
+    placeCheckpoints(*td, table_size, best_region_size, checkpoint);
+    spare_memory = memory_budget - estimatePeakMemory(*td, table_size, checkpoint, subtree_peak);
+    return true;
+}
+
+bool TreewidthSolver::checkMemory(uint64_t bytes) {
+    if (!stopped && (cancelled || (bytes >= MIN_CHECKED_TABLE_BYTES && bytes > memoryLeft(cfg->max_memory_in_bytes))))
+        stopped = true;
+    return !stopped;
+}
+
+bool TreewidthSolver::considerRestart(double new_cost) {
+    const double cost = dp_cost;
+    if (cost == 0 || cancelled)
+        return false;
+    const uint64_t total = states_total, done = std::min<uint64_t>(states_done, total);
+    const double left = total == 0 ? 1 : 1 - static_cast<double>(done) / static_cast<double>(total);
+    if (new_cost * RESTART_SPEEDUP >= cost * left)
+        return false;
+    return !cancelled.exchange(true);
+}
+
+bool TreewidthSolver::reserveMemory(uint64_t bytes) {
+    uint64_t spare = spare_memory;
+    while (spare >= bytes) {
+        if (spare_memory.compare_exchange_weak(spare, spare - bytes))
+            return true;
+    }
+    return false;
+}
+
+std::pair<int, int> TreewidthSolver::getWidthAndSplitter(const BranchingOverlay &instance) const {
+    auto &td = instance.decomposition();
+    int biggest_bag = 0;
+    for (int i = 1; i < td.size(); i++) {
+        if (instance.bagSize(i) > instance.bagSize(biggest_bag))
+            biggest_bag = i;
+    }
     int join_tw = 0;
 
     const int cutoff = cfg->good_enough_treewidth;
     std::vector<int> important_bags;
     for (int i = 0; i < td.size(); i++) {
-        if (static_cast<int>(td.bag[i].size()) > cutoff && td.adj[i].size() > 2) {
+        if (instance.bagSize(i) > cutoff && td.adj[i].size() > 2) {
             important_bags.push_back(i);
-            join_tw = std::max(join_tw, static_cast<int>(td.bag[i].size()));
+            join_tw = std::max(join_tw, instance.bagSize(i));
         }
     }
 
-    std::vector counts(instance.all_nodes.size(), 0);
+    std::vector counts(instance.idBound(), 0);
     for (auto bag : important_bags) {
-        for (auto v : td.bag[bag]) counts[v]++;
+        instance.forEachInBag(bag, [&](int v) { counts[v]++; });
     }
 
-    DS_ASSERT(!td.bag[biggest_bag].empty());
-    int v = td.bag[biggest_bag][0];
-    for (auto u : td.bag[biggest_bag]) {
-        if (counts[v] < counts[u] || (counts[v] == counts[u] && instance.deg(v) > instance.deg(u)))
+    // Taken and ignored vertices leave the bags, so a step that takes or ignores the last
+    // vertices of a join bag just above good_enough_treewidth, with the takes its ignore forces,
+    // can empty every bag. Then there is nothing left to branch on and the width is 0.
+    if (instance.bagSize(biggest_bag) == 0)
+        return { 0, -1 };
+    int v = -1;
+    instance.forEachInBag(biggest_bag, [&](int u) {
+        if (v < 0 || counts[v] < counts[u] || (counts[v] == counts[u] && instance.deg(v) > instance.deg(u)))
             v = u;
-    }
+    });
 
     return { join_tw, v };
 }
 
-TreewidthSolver::BranchingEstimate TreewidthSolver::estimateBranching(const ExtendedInstance &instance, int depth) {
+TreewidthSolver::BranchingEstimate TreewidthSolver::estimateBranching(BranchingOverlay &instance, std::vector<BranchStep> &path, std::vector<std::vector<BranchStep>> &plan, int depth) {
     auto [tw, v] = getWidthAndSplitter(instance);
 
-    if (tw <= cfg->good_enough_treewidth) {
+    // A leaf has to fit as the plain DP does, the lower bound on the treewidth relies on it.
+    const size_t max_states = pow3[maxWidth(cfg)];
+    if (tw <= cfg->good_enough_treewidth && maxStates(instance, max_states) <= max_states) {
+        plan.push_back(path);
         return { depth, 1 };
     }
-    if (depth == cfg->max_bag_branch_depth) {
+    if (depth == cfg->max_bag_branch_depth || v < 0) {
         return { INF, 1 };
     }
 
     BranchingEstimate total_estimate{ 0, 0 };
 
-    auto branch = [&](const ExtendedInstance &new_instance) {
-        auto estimate = estimateBranching(new_instance, depth + 1);
+    auto branch = [&](std::initializer_list<BranchStep> steps) {
+        const size_t checkpoint = instance.checkpoint();
+        for (auto step : steps) {
+            if (step.take)
+                instance.take(step.v);
+            else
+                instance.ignore(step.v);
+            path.push_back(step);
+        }
+        auto estimate = estimateBranching(instance, path, plan, depth + 1);
+        instance.undo(checkpoint);
+        path.resize(path.size() - steps.size());
+
         total_estimate.depth_needed = std::max(total_estimate.depth_needed, estimate.depth_needed);
         total_estimate.leaves += estimate.leaves;
         if (estimate.depth_needed >= INF) {
@@ -142,22 +598,14 @@ TreewidthSolver::BranchingEstimate TreewidthSolver::estimateBranching(const Exte
 
     if (instance.isDominated(v)) {
         if (!instance.isDisregarded(v)) {
-            auto instance_take = instance;
-            instance_take.take(v);
-            if (!branch(instance_take))
+            if (!branch({ { v, true } }))
                 return total_estimate;
         }
-        auto instance_ignore = instance;
-        instance_ignore.ignore(v);
-        if (!branch(instance_ignore))
+        if (!branch({ { v, false } }))
             return total_estimate;
     } else {
-        for (auto taken : instance[v].dominators) {
-            auto new_instance = instance;
-            new_instance.take(taken);
-            if (taken != v)
-                new_instance.ignore(v);
-            if (!branch(new_instance))
+        for (auto taken : instance.dominators(v)) {
+            if (!branch(taken != v ? std::initializer_list<BranchStep>{ { taken, true }, { v, false } } : std::initializer_list<BranchStep>{ { v, true } }))
                 return total_estimate;
         }
     }
@@ -165,59 +613,64 @@ TreewidthSolver::BranchingEstimate TreewidthSolver::estimateBranching(const Exte
     return total_estimate;
 }
 
-bool TreewidthSolver::solveBranching(ExtendedInstance &instance) {
-    auto [tw, v] = getWidthAndSplitter(instance);
-
-    if (tw <= cfg->good_enough_treewidth) {
-        // cfg->logLine(std::format("branch {}/{}", solved_leaves, total_leaves));
-        solved_leaves++;
-        auto ds = solveDecomp(instance, instance.td);
-        if (ds.has_value()) {
-            instance.ds = *ds;
-            return true;
-        }
-        return false;
+std::optional<std::vector<int>> TreewidthSolver::solveLeaf(const Instance &instance, const std::shared_ptr<const NiceTreeDecomposition> &nice_td, const std::vector<BranchStep> &steps, std::shared_ptr<TaskPool> leaf_pool, uint64_t memory) {
+    auto leaf_instance = instance;
+    for (auto step : steps) {
+        if (step.take)
+            leaf_instance.take(step.v);
+        else
+            leaf_instance.ignore(step.v);
     }
 
-    std::vector<int> best_ds;
-
-    auto branch = [&](ExtendedInstance &new_instance) {
-        if (!solveBranching(new_instance)) {
-            return false;
-        }
-
-        if (best_ds.empty() || best_ds.size() > new_instance.ds.size()) {
-            best_ds = new_instance.ds;
-        }
+    TreewidthSolver leaf(cfg, std::move(leaf_pool), memory);
+    auto ds = leaf.solveDecomp(leaf_instance, nice_td, best_size);
+    if (!ds.has_value())
+        return std::nullopt;
 
-        return true;
-    };
+    size_t best = best_size;
+    while (ds->size() < best && !best_size.compare_exchange_weak(best, ds->size())) {
+    }
+    solved_leaves++;
+    // cfg->logLine(std::format("branch {}/{}", solved_leaves.load(), total_leaves));
+    return ds;
+}
 
-    if (instance.isDominated(v)) {
-        if (!instance.isDisregarded(v)) {
-            auto instance_take = instance;
-            instance_take.take(v);
-            if (!branch(instance_take))
-                return false;
+std::optional<std::vector<int>> TreewidthSolver::solveBranching(const Instance &instance, const TreeDecomposition &raw_td, const std::vector<std::vector<BranchStep>> &leaves) {
+    if (leaves.empty())
+        return std::nullopt;
+    solved_leaves = 0;
+    total_leaves = leaves.size();
+    best_size = greedyDominatingSet(instance).size();
+
+    // Leaves differ from the instance only by removed vertices, so they all share its decomposition.
+    const auto nice_td = std::make_shared<const NiceTreeDecomposition>(NiceTreeDecomposition::nicify(instance, raw_td, true));
+
+    // Leaves solved in parallel compute their tables sequentially, so that at most one of them
+    // runs per thread, each in its share of the memory.
+    std::vector<std::optional<std::vector<int>>> ds(leaves.size());
+    const size_t n_workers = pool == nullptr ? 1 : std::min<size_t>(pool->size(), leaves.size());
+    if (n_workers > 1) {
+        std::atomic<size_t> next_leaf = 0;
+        TaskPool::Group group;
+        for (size_t w = 0; w < n_workers; w++) {
+            pool->spawn(group, [&] {
+                for (size_t i = next_leaf++; i < leaves.size(); i = next_leaf++) ds[i] = solveLeaf(instance, nice_td, leaves[i], nullptr, memory_budget / n_workers);
+            });
         }
+        pool->wait(group);
+    }
 
-        auto instance_ignore = instance;
-        instance_ignore.ignore(v);
-        if (!branch(instance_ignore))
-            return false;
-    } else {
-        for (auto taken : instance[v].dominators) {
-            auto new_instance = instance;
-            new_instance.take(taken);
-            if (taken != v)
-                new_instance.ignore(v);
-            if (!branch(new_instance))
-                return false;
-        }
+    std::optional<std::vector<int>> best_ds;
+    for (size_t i = 0; i < leaves.size(); i++) {
+        if (!ds[i].has_value())
+            ds[i] = solveLeaf(instance, nice_td, leaves[i], pool, memory_budget);
+        if (!ds[i].has_value())
+            return std::nullopt;
+        if (!best_ds.has_value() || best_ds->size() > ds[i]->size())
+            best_ds = std::move(ds[i]);
     }
 
-    instance.ds = best_ds;
-    return true;
+    return best_ds;
 }
 
 inline int TreewidthSolver::cost(int v) const {
@@ -226,122 +679,139 @@ inline int TreewidthSolver::cost(int v) const {
     return 1;
 }
 
-int TreewidthSolver::getC(int t, TernaryFun f) {
-    const auto &node = td[t];
-    DS_ASSERT(f < pow3[node.bag_size]);
+inline bool TreewidthSolver::isForced(int u, int v) const {
+    EdgeStatus edge_status = g.getEdgeStatus(u, v);
+    DS_ASSERT(edge_status == EdgeStatus::UNCONSTRAINED ||
+              edge_status == EdgeStatus::FORCED);
+    return edge_status == EdgeStatus::FORCED;
+}
+
+void TreewidthSolver::computeTable(int t, bool keep_children) {
+    if (!c[t].empty())
+        return;
+
+    const auto &node = (*td)[t];
+    if (node.type == NiceTreeDecomposition::NodeType::Join) {
+        // Subtrees of a Join are independent, the other one runs as a task if memory allows it.
+        const int r = node.r_child;
+        const uint64_t r_peak = subtree_peak[r];
+        if (pool != nullptr && c[r].empty() && r_peak >= MIN_PARALLEL_SUBTREE_BYTES && reserveMemory(r_peak)) {
+            TaskPool::Group group;
+            pool->spawn(group, [&] { computeTable(r, keep_children); });
+            computeTable(node.l_child, keep_children);
+            pool->wait(group);
+            spare_memory += r_peak;
+        } else {
+            computeTable(node.l_child, keep_children);
+            computeTable(r, keep_children);
+        }
+    } else if (node.type != NiceTreeDecomposition::NodeType::Leaf) {
+        computeTable(node.l_child, keep_children);
+    }
+    // The plan only accounts for the tables, the rest of the process may have grown since. Tables
+    // on disk are written back instead of taking memory. A cancelled DP stops here too.
+    if (!checkMemory(on_disk[t] ? 0 : space[t].size() * valueWidth(max_value[t])))
+        return;
 
-    if (!c[t].empty() && c[t][f] != UNSET)
-        return c[t][f];
-    if (c[t].empty())
-        c[t].resize(pow3[node.bag_size], UNSET);
-    c[t][f] = INF;
+    c[t].spill_dir = on_disk[t] ? &cfg->spill_directory : nullptr;
+    const auto &l = node.l_child >= 0 ? c[node.l_child] : c[t];
 
     switch (node.type) {
-        case NiceTreeDecomposition::NodeType::Leaf:
-            return c[t][f] = 0;
+        case NiceTreeDecomposition::NodeType::Leaf: {
+            c[t].reset(1, 0, 0, [](auto &values) { values[0] = 0; });
+            break;
+        }
         case NiceTreeDecomposition::NodeType::IntroduceVertex: {
-            int pos = node.pos_v;
-            Color f_v = at(f, pos);
-            // This vertex could already be dominated by some reduction rule.
-            if (f_v == Color::WHITE && !g.isDominated(node.v))
-                return c[t][f] = INF;
-            return c[t][f] = getC(node.l_child, cut(f, pos));
+            // Vertices removed by bag-branching stay in the bags of the decomposition shared by its
+            // leaves, with a single color and none of their edges.
+            std::vector<IntroducedEdge> edges;
+            for (size_t i = 0; i < node.edges_to.size(); i++) {
+                if (g.hasNode(node.v) && g.hasNode(node.edges_to[i]))
+                    edges.push_back({ node.pos_edges_to[i], isForced(node.v, node.edges_to[i]) });
+            }
+            // This vertex could already be dominated by some reduction rule, then it has no WHITE
+            // states.
+            introduceVertex(l, c[t], space[t], node.pos_v, edges);
+            break;
         }
         case NiceTreeDecomposition::NodeType::IntroduceEdge: {
-            int pos_u = node.pos_to;
-            int pos_v = node.pos_v;
-
-            Color f_u = at(f, pos_u);
-            Color f_v = at(f, pos_v);
-
-            EdgeStatus edge_status = g.getEdgeStatus(node.to, node.v);
-            DS_ASSERT(edge_status == EdgeStatus::UNCONSTRAINED ||
-                      edge_status == EdgeStatus::FORCED);
-            if (edge_status == EdgeStatus::FORCED) {
-                // We are forced to take at least one of the endpoints of the edge to the
-                // dominating set.
-                if (f_u == Color::BLACK && f_v == Color::WHITE)
-                    return c[t][f] = getC(node.l_child, setUnset(f, pos_v, Color::GRAY));
-                if (f_u == Color::WHITE && f_v == Color::BLACK)
-                    return c[t][f] = getC(node.l_child, setUnset(f, pos_u, Color::GRAY));
-                if (f_u == Color::BLACK || f_v == Color::BLACK)
-                    return c[t][f] = getC(node.l_child, f);
-                return c[t][f] = INF;
-            }
-            if (f_u == Color::BLACK && f_v == Color::WHITE)
-                return c[t][f] = getC(node.l_child, setUnset(f, pos_v, Color::GRAY));
-            if (f_u == Color::WHITE && f_v == Color::BLACK)
-                return c[t][f] = getC(node.l_child, setUnset(f, pos_u, Color::GRAY));
-            return c[t][f] = getC(node.l_child, f);
+            // We are forced to take at least one of the endpoints of the edge to the
+            // dominating set.
+            introduceEdge(l, c[t], space[t], node.pos_to, node.pos_v, isForced(node.to, node.v));
+            break;
         }
         case NiceTreeDecomposition::NodeType::Forget: {
-            int pos_v = node.pos_v;
-            int cost_take = cost(node.v);
-            // Skip the branching if we already know the solution would be nonoptimal.
-            if (cost_take < INF) {
-                return c[t][f] = std::min(
-                           cost_take + getC(node.l_child, insert(f, pos_v, Color::BLACK)),
-                           getC(node.l_child, insert(f, pos_v, Color::WHITE)));
-            }
-
-            return c[t][f] = getC(node.l_child, insert(f, pos_v, Color::WHITE));
+            std::vector<int> cost_take;
+            for (int v : node.forgotten) cost_take.push_back(cost(v));
+            forget(l, c[t], space[node.l_child], node.pos_forgotten, cost_take, max_value[t], pool.get());
+            break;
         }
         case NiceTreeDecomposition::NodeType::Join: {
-            int N = node.bag_size;
-            std::vector<int> zeroes;
-            for (int i = 0; i < N; ++i) {
-                if (at(f, i) == Color::WHITE)
-                    zeroes.push_back(i);
-            }
-
-            // Iterate over all combinations of choosing f_1(v), f_2(v) for positions where
-            // f(v) = 0.
-            for (int mask = 0; mask < (1 << zeroes.size()); mask++) {
-                // The value of f_1, f_2 will be the same on all trits that ain't 0 in f, so
-                // we don't need to touch those.
-                TernaryFun f_1 = f, f_2 = f;
-                for (size_t i = 0; i < zeroes.size(); ++i) {
-                    if (mask >> i & 1) {
-                        f_1 = setUnset(f_1, zeroes[i], Color::GRAY);
-                    } else {
-                        f_2 = setUnset(f_2, zeroes[i], Color::GRAY);
-                    }
-                }
-                c[t][f] = std::min(c[t][f],
-                                   getC(node.l_child, f_1) + getC(node.r_child, f_2));
-            }
-            return c[t][f];
+            // The plan doesn't count the transforms of the join, they get what is spare meanwhile,
+            // shared by the chunks that may run at once. Tasks started meanwhile run sequentially.
+            const uint64_t scratch = spare_memory.exchange(0);
+            join(l, c[node.r_child], c[t], space[t], max_value[t], pool.get(), scratch / (pool == nullptr ? 1 : pool->size()));
+            spare_memory += scratch;
+            break;
         }
+        default:
+            throw std::logic_error("Unknown node type reached in computeTable!");
     }
+    states_done += space[t].size();
 
-    throw std::logic_error("Unknown node type reached in calc_c!");
+    for (int child : { node.l_child, node.r_child }) {
+        if (child >= 0 && !keep_children && !checkpoint[child])
+            c[child].clear();
+    }
 }
 
 void TreewidthSolver::recoverDS(int t, TernaryFun f) {
-    auto &node = td[t];
-    DS_ASSERT(f < pow3[node.bag_size]);
-    DS_ASSERT(!c[t].empty() && c[t][f] != UNSET);
+    auto &node = (*td)[t];
+    const auto &s = space[t];
+    DS_ASSERT(f < s.size());
+    DS_ASSERT(!c[t].empty() && c[t].get(f) < INF);
+
+    // The tables below checkpoints were freed during the forward pass, recompute them keeping
+    // every table until recovery reaches it.
+    for (int child : { node.l_child, node.r_child }) {
+        if (child >= 0)
+            computeTable(child, true);
+    }
+    if (stopped)
+        return;
+
+    // Each node is recovered exactly once, so its table is no longer needed.
+    const int value = c[t].get(f);
+    c[t].clear();
+
     switch (node.type) {
         case NiceTreeDecomposition::NodeType::IntroduceVertex: {
             int pos = node.pos_v;
-            recoverDS(node.l_child, cut(f, pos));
+            // A BLACK v dominates its WHITE neighbours, which are GRAY in the child.
+            if (s.at(f, pos) == Color::BLACK) {
+                for (int pos_to : node.pos_edges_to) {
+                    if (s.at(f, pos_to) == Color::WHITE)
+                        f = s.set(f, pos_to, Color::GRAY);
+                }
+            }
+            recoverDS(node.l_child, s.cut(f, pos));
             return;
         }
         case NiceTreeDecomposition::NodeType::IntroduceEdge: {
             int pos_u = node.pos_to;
             int pos_v = node.pos_v;
 
-            Color f_u = at(f, pos_u);
-            Color f_v = at(f, pos_v);
+            Color f_u = s.at(f, pos_u);
+            Color f_v = s.at(f, pos_v);
 
             EdgeStatus edge_status = g.getEdgeStatus(node.to, node.v);
             DS_ASSERT(edge_status == EdgeStatus::UNCONSTRAINED ||
                       edge_status == EdgeStatus::FORCED);
             if (edge_status == EdgeStatus::FORCED) {
                 if (f_u == Color::BLACK && f_v == Color::WHITE)
-                    recoverDS(node.l_child, setUnset(f, pos_v, Color::GRAY));
+                    recoverDS(node.l_child, s.set(f, pos_v, Color::GRAY));
                 else if (f_u == Color::WHITE && f_v == Color::BLACK)
-                    recoverDS(node.l_child, setUnset(f, pos_u, Color::GRAY));
+                    recoverDS(node.l_child, s.set(f, pos_u, Color::GRAY));
                 else if (f_u == Color::BLACK || f_v == Color::BLACK)
                     recoverDS(node.l_child, f);
                 else
@@ -349,48 +819,68 @@ void TreewidthSolver::recoverDS(int t, TernaryFun f) {
                         "entered IntroduceEdge state corresponding to no solution");
             } else {
                 if (f_u == Color::BLACK && f_v == Color::WHITE)
-                    recoverDS(node.l_child, setUnset(f, pos_v, Color::GRAY));
+                    recoverDS(node.l_child, s.set(f, pos_v, Color::GRAY));
                 else if (f_u == Color::WHITE && f_v == Color::BLACK)
-                    recoverDS(node.l_child, setUnset(f, pos_u, Color::GRAY));
+                    recoverDS(node.l_child, s.set(f, pos_u, Color::GRAY));
                 else
                     recoverDS(node.l_child, f);
             }
             return;
         }
         case NiceTreeDecomposition::NodeType::Forget: {
-            int pos_v = node.pos_v;
-            if (c[t][f] ==
-                cost(node.v) + getC(node.l_child, insert(f, pos_v, Color::BLACK))) {
-                g.ds.push_back(node.v);
-                recoverDS(node.l_child, insert(f, pos_v, Color::BLACK));
-            } else {
-                recoverDS(node.l_child, insert(f, pos_v, Color::WHITE));
+            // Find which of the forgotten vertices to take, each of the others is dominated, WHITE
+            // unless it was dominated before.
+            const auto &child_space = space[node.l_child];
+            const int k = node.forgotten.size();
+            const auto colors = s.decode(f);
+            std::vector<Color> child_colors;
+            for (size_t taken = 0; taken < (size_t{ 1 } << k); taken++) {
+                int taken_cost = 0;
+                child_colors = colors;
+                for (int i = 0; i < k; i++) {
+                    const bool take = taken >> i & 1;
+                    const int p = node.pos_forgotten[i];
+                    taken_cost += take ? cost(node.forgotten[i]) : 0;
+                    child_colors.insert(child_colors.begin() + p, take ? Color::BLACK : child_space.colors[p].lowest);
+                }
+                if (taken_cost >= INF || value != taken_cost + c[node.l_child].get(child_space.encode(child_colors)))
+                    continue;
+
+                for (int i = 0; i < k; i++) {
+                    if (taken >> i & 1)
+                        g.ds.push_back(node.forgotten[i]);
+                }
+                recoverDS(node.l_child, child_space.encode(child_colors));
+                return;
             }
-            return;
+
+            throw std::logic_error("encountered invalid forget state");
         }
         case NiceTreeDecomposition::NodeType::Join: {
             int N = node.bag_size;
             std::vector<int> zeroes;
             for (int i = 0; i < N; ++i) {
-                if (at(f, i) == Color::WHITE)
+                if (s.at(f, i) == Color::WHITE)
                     zeroes.push_back(i);
             }
 
             // Iterate over all combinations of choosing f_1(v), f_2(v) for positions where
-            // f(v) = 0.
-            for (int mask = 0; mask < (1 << zeroes.size()); mask++) {
-                // The value of f_1, f_2 will be the same on all trits that ain't 0 in f, so
-                // we don't need to touch those.
-                TernaryFun f_1 = f, f_2 = f;
-                for (size_t i = 0; i < zeroes.size(); ++i) {
-                    if (mask >> i & 1) {
-                        f_1 = setUnset(f_1, zeroes[i], Color::GRAY);
-                    } else {
-                        f_2 = setUnset(f_2, zeroes[i], Color::GRAY);
-                    }
+            // f(v) = 0. The value of f_1, f_2 will be the same on all trits that ain't 0 in f, so
+            // we don't need to touch those. The masks are walked in Gray code order, so that f_1
+            // and f_2 change by a single trit between consecutive masks.
+            TernaryFun all_gray = 0, f_1_gray = 0;
+            for (int z : zeroes) all_gray += s.stride[z];
+            for (size_t i = 0; i < (size_t{ 1 } << zeroes.size()); i++) {
+                if (i > 0) {
+                    const int flipped = std::countr_zero(i);
+                    if ((i ^ i >> 1) >> flipped & 1)
+                        f_1_gray += s.stride[zeroes[flipped]];
+                    else
+                        f_1_gray -= s.stride[zeroes[flipped]];
                 }
 
-                if (c[t][f] == getC(node.l_child, f_1) + getC(node.r_child, f_2)) {
+                const TernaryFun f_1 = f + f_1_gray, f_2 = f + all_gray - f_1_gray;
+                if (value == c[node.l_child].get(f_1) + c[node.r_child].get(f_2)) {
                     recoverDS(node.l_child, f_1);
                     recoverDS(node.r_child, f_2);
                     return;
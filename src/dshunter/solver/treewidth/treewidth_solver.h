@@ -1,24 +1,21 @@
 #ifndef DS_TREEWIDTH_SOLVER_H
 #define DS_TREEWIDTH_SOLVER_H
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <memory>
 
 #include "../../instance.h"
 #include "../solver.h"
+#include "../task_pool.h"
+#include "branching_overlay.h"
+#include "dp_table.h"
+#include "state_space.h"
 #include "td/decomposer.h"
 #include "td/nice_tree_decomposition.h"
-#include "ternary.h"
 
 namespace DSHunter {
 
-struct ExtendedInstance : Instance {
-    TreeDecomposition td;
-
-    ExtendedInstance(const Instance &instance, TreeDecomposition td);
-
-    void removeNode(int v) override;
-};
-
 struct TreewidthSolver {
     explicit TreewidthSolver(SolverConfig *cfg);
     // Returns true if instance was solved,
@@ -34,25 +31,95 @@ struct TreewidthSolver {
         int leaves;
     };
 
-    std::vector<std::vector<int>> c;
+    // Vertex taken or ignored on the way from the root of the bag-branching to a leaf.
+    struct BranchStep {
+        int v;
+        bool take;
+    };
+
+    // Solver of a single leaf of the bag-branching, with its own tables.
+    TreewidthSolver(SolverConfig *cfg, std::shared_ptr<TaskPool> pool, uint64_t memory_budget);
+
+    std::vector<DPTable> c;
+    // Size of the best known solution of the instance solved by the DP, not counting g.ds.
+    int incumbent;
+    // Upper bound on the values of each table, used to pick the width of its entries. Values
+    // above it only lead to solutions worse than the incumbent and are pruned.
+    std::vector<int> max_value;
+    // Nodes whose tables survive the forward pass of the DP, every other table is freed as soon
+    // as its parent is computed and recomputed from the checkpoints below it during recovery.
+    std::vector<bool> checkpoint;
+    // Nodes whose tables are kept in files under cfg->spill_directory instead of in memory.
+    std::vector<bool> on_disk;
+    // Peak memory of computing the table of each subtree, and the memory left over by the plan.
+    // A Join node computes its subtrees in parallel only if it can reserve the peak of one of them.
+    std::vector<uint64_t> subtree_peak;
+    std::atomic<uint64_t> spare_memory;
+    // Memory the DP may take, what is left of max_memory_in_bytes once the decomposition is found,
+    // or a share of it for leaves solved in parallel.
+    uint64_t memory_budget;
+    // Set from another thread when the DP is better restarted on a cheaper decomposition.
+    std::atomic<bool> cancelled;
+    // Set once the process comes close to max_memory_in_bytes anyway, or once cancelled is, then
+    // the DP stops and solveDecomp gives up instead of getting the process killed.
+    std::atomic<bool> stopped;
+    // Returns false, setting stopped, if a table of the given size won't fit or the DP is cancelled.
+    bool checkMemory(uint64_t bytes);
+    // Predicted cost of the decomposition the DP runs on, 0 when none runs, and the progress of
+    // the DP, in states of the tables computed out of all of them.
+    std::atomic<double> dp_cost;
+    std::atomic<uint64_t> states_done, states_total;
+    // Cancels the DP if a decomposition of the given predicted cost is expected to be solved in
+    // less than what is left of it, by a margin. Returns true if this call cancelled it.
+    bool considerRestart(double new_cost);
+    std::shared_ptr<TaskPool> pool;
+    bool reserveMemory(uint64_t bytes);
     Instance g;
     [[nodiscard]] inline int cost(int v) const;
+    [[nodiscard]] inline bool isForced(int u, int v) const;
 
-    NiceTreeDecomposition td;
-    std::optional<std::vector<int>> solveDecomp(const Instance &instance, const TreeDecomposition &td);
+    // Shared by the solvers of all leaves of the bag-branching.
+    std::shared_ptr<const NiceTreeDecomposition> td;
+    // States of the bag of each node, each vertex having only the colors it can take.
+    std::vector<StateSpace> space;
+    // Returns an optimal solution, or some solution with more than upper_bound vertices if no
+    // solution has at most that many. Returns nullopt if the tables don't fit in memory.
+    std::optional<std::vector<int>> solveDecomp(const Instance &instance, const TreeDecomposition &td, size_t upper_bound = SIZE_MAX);
+    // Same, on a fused nice decomposition of instance, or of one it was made from by removing
+    // vertices.
+    std::optional<std::vector<int>> solveDecomp(const Instance &instance, std::shared_ptr<const NiceTreeDecomposition> nice_td, size_t upper_bound);
 
-    [[nodiscard]] std::pair<int, int> getWidthAndSplitter(const ExtendedInstance &instance) const;
+    [[nodiscard]] std::pair<int, int> getWidthAndSplitter(const BranchingOverlay &instance) const;
 
-    BranchingEstimate estimateBranching(const ExtendedInstance &instance, int depth = 0);
+    // Walks the bag-branching tree over the overlay, appending the steps to each leaf, reached by
+    // path, to plan. The plan is complete only if the depth needed is within max_bag_branch_depth.
+    BranchingEstimate estimateBranching(BranchingOverlay &instance, std::vector<BranchStep> &path, std::vector<std::vector<BranchStep>> &plan, int depth = 0);
 
-    int solved_leaves;
+    std::atomic<int> solved_leaves;
     int total_leaves;
-    bool solveBranching(ExtendedInstance &instance);
+    // Size of the best solution found by the bag-branching so far, bounding the DP of the leaves.
+    std::atomic<size_t> best_size;
+    std::optional<std::vector<int>> solveLeaf(const Instance &instance, const std::shared_ptr<const NiceTreeDecomposition> &nice_td, const std::vector<BranchStep> &steps, std::shared_ptr<TaskPool> leaf_pool, uint64_t memory);
+    // Solves the leaves in parallel, each with a share of the memory, and then those that didn't
+    // fit in it one by one. Returns the best of their solutions, or nullopt if some leaf didn't fit.
+    std::optional<std::vector<int>> solveBranching(const Instance &instance, const TreeDecomposition &td, const std::vector<std::vector<BranchStep>> &leaves);
+
+    // Picks the tables spilled to disk and the checkpoint nodes so that the peak memory of the DP
+    // fits in memory_budget. Tables are only spilled if they can't all be kept in memory.
+    // Returns false if no such choice exists.
+    bool planMemory();
+
+    // Picks the checkpoint nodes for the given memory taken by each table, or returns false if
+    // the DP can't fit in memory_budget.
+    bool planCheckpoints(const std::vector<uint64_t> &table_size);
 
     // [Parameterized Algorithms [7.3.2] - 10.1007/978-3-319-21275-3] extended to handle forced
     // edges.
-    int getC(int t, TernaryFun f);
+    // Fills c[t] for all states, computing the tables of the subtree of t that are not present.
+    // Child tables are freed afterwards, unless they are checkpoints or keep_children is set.
+    void computeTable(int t, bool keep_children);
 
+    // Recovers the solution from c[t][f], freeing the tables of the subtree of t on the way.
     void recoverDS(int t, TernaryFun f);
 };
 }  // namespace DSHunter
@@ -1,11 +1,274 @@
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <random>
 #include <sstream>
 
 #include "../dshunter.h"
+#include "../solver/memory_limit.h"
+#include "../solver/treewidth/dp_kernels.h"
+
+namespace {
+
+constexpr int INF = DSHunter::DPTable::INF;
+
+std::mt19937 rng(2024);
+
+DSHunter::DPTable makeTable(const std::vector<int> &values) {
+    int lo = INF, hi = 0;
+    for (int x : values) {
+        if (x < INF) {
+            lo = std::min(lo, x);
+            hi = std::max(hi, x);
+        }
+    }
+    if (lo == INF)
+        lo = hi = 0;
+    DSHunter::DPTable table;
+    table.reset(values.size(), lo, hi - lo, [&](auto &out) {
+        using T = std::decay_t<decltype(out[0])>;
+        for (size_t i = 0; i < values.size(); i++) out[i] = values[i] >= INF ? DSHunter::DPTable::SATURATED<T> : static_cast<T>(values[i] - lo);
+    });
+    return table;
+}
+
+DSHunter::StateSpace randomSpace(int k, bool mixed) {
+    std::vector<DSHunter::Colors> colors;
+    for (int i = 0; i < k; i++) colors.push_back(mixed ? DSHunter::Colors::of(rng() % 3 == 0, rng() % 3 == 0) : DSHunter::Colors::of(false, false));
+    return DSHunter::StateSpace(colors);
+}
+
+// Returns a table that is monotone as the DP tables are, WHITE never cheaper than GRAY, with
+// values spread over at most spread + 1 levels and about infeasible percent of states infeasible.
+std::vector<int> monotoneTable(const DSHunter::StateSpace &space, int spread, int infeasible) {
+    std::vector<int> values(space.size());
+    const int base = rng() % 100;
+    for (size_t f = space.size(); f-- > 0;) {
+        values[f] = static_cast<int>(rng() % 100) < infeasible ? INF : base + static_cast<int>(rng() % (spread + 1));
+        for (int p = 0; p < space.n_positions(); p++) {
+            if (space.at(f, p) == DSHunter::Color::WHITE)
+                values[f] = std::max(values[f], values[f + space.stride[p]]);
+        }
+    }
+    return values;
+}
+
+// Checks the join kernel against its definition, with the covering product computed both by the
+// transforms and directly. Groups of many free positions and few levels take the transforms,
+// a scratch limit of 0 forces the direct join.
+bool checkJoin() {
+    for (int it = 0; it < 300; it++) {
+        const int k = it < 20 ? 12 + rng() % 2 : rng() % 9;
+        const int spread = it < 20 || rng() % 2 ? rng() % 3 : rng() % 300;
+        const int infeasible = rng() % 3 ? 0 : rng() % 40;
+        const auto space = randomSpace(k, it % 2);
+        const int max_value = it % 3 == 0 ? INF : 100 + rng() % 200;
+        const auto l = monotoneTable(space, spread, infeasible), r = monotoneTable(space, spread, infeasible);
+
+        DSHunter::DPTable by_transform, directly;
+        DSHunter::join(makeTable(l), makeTable(r), by_transform, space, max_value);
+        DSHunter::join(makeTable(l), makeTable(r), directly, space, max_value, nullptr, 0);
+        for (size_t f = 0; f < space.size(); f++) {
+            int expected = INF;
+            if (k < 12) {
+                std::vector<int> white;
+                for (int p = 0; p < k; p++) {
+                    if (space.at(f, p) == DSHunter::Color::WHITE)
+                        white.push_back(p);
+                }
+                for (int mask = 0; mask < (1 << white.size()); mask++) {
+                    DSHunter::TernaryFun f_l = f, f_r = f;
+                    for (size_t i = 0; i < white.size(); i++) {
+                        if (mask >> i & 1)
+                            f_l = space.set(f_l, white[i], DSHunter::Color::GRAY);
+                        else
+                            f_r = space.set(f_r, white[i], DSHunter::Color::GRAY);
+                    }
+                    expected = static_cast<int>(std::min<int64_t>(expected, static_cast<int64_t>(l[f_l]) + r[f_r]));
+                }
+                if (expected > max_value)
+                    expected = INF;
+            } else {
+                expected = directly.get(f);
+            }
+            if (by_transform.get(f) != expected || directly.get(f) != expected) {
+                std::cerr << "join of " << k << " positions gives " << by_transform.get(f) << " by the transforms and "
+                          << directly.get(f) << " directly for state " << f << ", expected " << expected << "\n";
+                return false;
+            }
+        }
+    }
+    std::cerr << "[OK] join kernel\n";
+    return true;
+}
+
+// Checks that forgetting several vertices at once gives the same table as forgetting them one
+// by one, as the fused decomposition does with consecutive Forget nodes.
+bool checkForget() {
+    for (int it = 0; it < 1000; it++) {
+        const int k = 2 + rng() % 8;
+        const auto space = randomSpace(k, it % 2);
+        std::vector<int> pos(k);
+        for (int p = 0; p < k; p++) pos[p] = p;
+        std::ranges::shuffle(pos, rng);
+        pos.resize(2 + rng() % (k - 1));
+        std::ranges::sort(pos);
+        std::vector<int> cost_take;
+        for (size_t i = 0; i < pos.size(); i++) cost_take.push_back(rng() % 3 ? 1 : INF);
+        const int max_value = it % 4 == 0 ? INF : 120 + rng() % 100;
+        const auto child = makeTable(monotoneTable(space, it % 2 ? 3 : 300, rng() % 20));
+
+        DSHunter::DPTable fused;
+        DSHunter::forget(child, fused, space, pos, cost_take, max_value);
+        DSHunter::DPTable sequential;
+        DSHunter::StateSpace current = space;
+        for (int i = static_cast<int>(pos.size()) - 1; i >= 0; i--) {
+            DSHunter::DPTable next;
+            DSHunter::forget(i + 1 == static_cast<int>(pos.size()) ? child : sequential, next, current, { pos[i] }, { cost_take[i] }, max_value);
+            sequential = std::move(next);
+            current = current.removed({ pos[i] });
+        }
+        for (size_t f = 0; f < current.size(); f++) {
+            if (fused.get(f) != sequential.get(f)) {
+                std::cerr << "forget of " << pos.size() << " out of " << k << " positions gives " << fused.get(f)
+                          << " for state " << f << ", one by one " << sequential.get(f) << "\n";
+                return false;
+            }
+        }
+    }
+    std::cerr << "[OK] forget kernel\n";
+    return true;
+}
+
+std::string randomGraph(int n, double p) {
+    std::vector<std::pair<int, int>> edges;
+    for (int i = 1; i <= n; i++) {
+        for (int j = i + 1; j <= n; j++) {
+            if (std::uniform_real_distribution<>(0, 1)(rng) < p)
+                edges.emplace_back(i, j);
+        }
+    }
+    std::stringstream out;
+    out << "p ds " << n << " " << edges.size() << "\n";
+    for (auto [a, b] : edges) out << a << " " << b << "\n";
+    return out.str();
+}
+
+// Returns the limit leaving the DP about bytes of memory on top of what the process holds.
+size_t memoryLimitLeaving(size_t bytes) {
+    return (DSHunter::residentMemory() + bytes) * 16 / 15;
+}
+
+// Checks the treewidth DP against the brute-force solver on random graphs of min_n to max_n
+// vertices, with the configuration changed by configure. With shrink_memory, each graph is solved
+// again in half the memory until the DP gives up, so that the last runs have to make do with the
+// fewest tables alive.
+template <class F>
+bool checkAgainstBrute(const std::string &name, int n_graphs, int min_n, int max_n, double min_p, bool shrink_memory, F &&configure) {
+    DSHunter::Solver brute(DSHunter::SolverConfig(DSHunter::get_default_reduction_rules(),
+                                                  DSHunter::SolverType::Bruteforce,
+                                                  DSHunter::PresolverType::None));
+    for (int it = 0; it < n_graphs; it++) {
+        const std::string g_str = randomGraph(min_n + rng() % (max_n - min_n + 1), std::uniform_real_distribution<>(min_p, 1)(rng));
+        auto instance = [&] {
+            std::stringstream in(g_str);
+            return DSHunter::Instance(in);
+        };
+        const size_t expected = brute.solve(instance()).size();
+        for (size_t memory = 64 << 20; memory >= 1 << 10; memory /= 2) {
+            DSHunter::SolverConfig cfg(DSHunter::get_default_reduction_rules(), DSHunter::SolverType::TreewidthDP, DSHunter::PresolverType::None);
+            cfg.decomposition_time_budget = std::chrono::seconds(1);
+            configure(cfg);
+            if (shrink_memory)
+                cfg.max_memory_in_bytes = memoryLimitLeaving(memory);
+            try {
+                const size_t found = DSHunter::Solver(cfg).solve(instance()).size();
+                if (found != expected) {
+                    std::cerr << name << ": treewidth dp found ds of size " << found << ", expected " << expected << " for\n"
+                              << g_str;
+                    return false;
+                }
+            } catch (std::logic_error &e) {
+                if (shrink_memory && memory < (64 << 20) && std::string(e.what()).starts_with("treewidth dp failed"))
+                    break;
+                std::cerr << name << ": " << e.what() << " for\n"
+                          << g_str;
+                return false;
+            }
+            if (!shrink_memory)
+                break;
+        }
+    }
+    std::cerr << "[OK] " << name << "\n";
+    return true;
+}
+
+// Checks the paths of the DP that graphs of at most 7 vertices never take: tables recomputed
+// from checkpoints in a budget far below the sum of the tables, and tables spilled to disk.
+bool checkDPPaths() {
+    const auto spill_directory = std::filesystem::temp_directory_path().string();
+    return checkAgainstBrute("treewidth dp", 100, 8, 18, 0.1, false, [](DSHunter::SolverConfig &) {}) &&
+           checkAgainstBrute("treewidth dp with checkpoints", 30, 14, 18, 0.3, true, [](DSHunter::SolverConfig &) {}) &&
+           checkAgainstBrute("treewidth dp with spilled tables", 4, 17, 18, 0.85, true, [&](DSHunter::SolverConfig &cfg) {
+               cfg.spill_directory = spill_directory;
+           });
+}
+
+// Returns a random tree of n vertices with about extra edges added, of small treewidth.
+std::string randomTreeLikeGraph(int n, int extra) {
+    std::vector<std::pair<int, int>> edges;
+    for (int i = 2; i <= n; i++) edges.emplace_back(1 + rng() % (i - 1), i);
+    for (int i = 0; i < extra; i++) {
+        const int a = 1 + rng() % n, b = 1 + rng() % n;
+        if (a != b)
+            edges.emplace_back(std::min(a, b), std::max(a, b));
+    }
+    std::ranges::sort(edges);
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    std::stringstream out;
+    out << "p ds " << n << " " << edges.size() << "\n";
+    for (auto [a, b] : edges) out << a << " " << b << "\n";
+    return out.str();
+}
+
+// Checks that bag-branching with leaves solved in parallel, sharing the incumbent and splitting
+// the memory between threads, finds solutions of the same size as on a single thread.
+bool checkParallelBranching() {
+    for (int it = 0; it < 30; it++) {
+        const int n = 30 + rng() % 30;
+        const std::string g_str = randomTreeLikeGraph(n, n / 6 + rng() % (n / 4));
+        std::vector<size_t> sizes;
+        for (int n_threads : { 1, 4 }) {
+            DSHunter::SolverConfig cfg(DSHunter::get_default_reduction_rules(), DSHunter::SolverType::TreewidthDP, DSHunter::PresolverType::None);
+            cfg.decomposition_time_budget = std::chrono::seconds(1);
+            cfg.good_enough_treewidth = 2 + it % 4;
+            cfg.max_bag_branch_depth = 5;
+            cfg.n_threads = n_threads;
+            std::stringstream in(g_str);
+            try {
+                sizes.push_back(DSHunter::Solver(cfg).solve(DSHunter::Instance(in)).size());
+            } catch (std::logic_error &e) {
+                std::cerr << "bag-branching on " << n_threads << " threads: " << e.what() << " for\n"
+                          << g_str;
+                return false;
+            }
+        }
+        if (sizes[0] != sizes[1]) {
+            std::cerr << "bag-branching found ds of size " << sizes[1] << " on 4 threads, " << sizes[0] << " on one for\n"
+                      << g_str;
+            return false;
+        }
+    }
+    std::cerr << "[OK] parallel bag-branching\n";
+    return true;
+}
+
+}  // namespace
 
 // This test checks whether a brute-force solution gives the same result as the model solution
-// on all graphs with at most 7 vertices.
+// on all graphs with at most 7 vertices, then the kernels and the paths of the treewidth DP that
+// such graphs don't reach, bag-branching on several threads included.
 int main() {
     DSHunter::Solver brute_reductionless(DSHunter::SolverConfig(DSHunter::get_default_reduction_rules(),
                                                                 DSHunter::SolverType::Bruteforce,
@@ -47,8 +310,8 @@ int main() {
                     return 1;
                 }
 
-                if (sol_brute_reduce.size() != sol_brute_reductionless.size()) {
-                    std::cerr << "default_solver found ds of size " << sol_brute_reduce.size()
+                if (sol.size() != sol_brute_reductionless.size()) {
+                    std::cerr << "default_solver found ds of size " << sol.size()
                               << ", expected " << sol_brute_reductionless.size() << "\n";
                     return 1;
                 }
@@ -63,5 +326,7 @@ int main() {
         std::cerr << "\r[OK] for all " << (1 << max_edges) << " graphs with n = " << n << "\n";
     }
 
+    if (!checkJoin() || !checkForget() || !checkDPPaths() || !checkParallelBranching())
+        return 1;
     return 0;
 }
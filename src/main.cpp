@@ -18,6 +18,9 @@ void printHelp() {
         << "           [--decomposer] <decomposer executable>\n"
         << "           [--mode] <presolve/ds_size/treewidth>\n"
         << "           [--presolve <full/cheap/none>]\n"
+        << "           [--threads <count>]\n"
+        << "           [--spill_dir <directory>]\n"
+        << "           [--td_cache <directory>]\n"
         << "           [--short]\n"
         << "           [--help]\n\n"
 
@@ -25,9 +28,16 @@ void printHelp() {
         << "  --input_file    Read instance from specified file (default: stdin)\n"
         << "  --output_file   Write solution to specified file (default: stdout)\n"
         << "  --solver        Choose solving method: bruteforce, branching, treewidth_dp, vc\n"
-        << "  --decomposer    Use external executable to get tree decompositions\n"
+        << "  --decomposer    Use external executable to get tree decompositions, given more than\n"
+        << "                  once the executables run side by side and the first good enough\n"
+        << "                  decomposition wins\n"
         << "  --mode          Picks one of the non-default output modes for the solver\n"
         << "  --presolve      Choose presolver: full, cheap, none\n"
+        << "  --threads       Number of threads used by the solver (default: 1)\n"
+        << "  --spill_dir     Keep DP tables that don't fit in memory in files in this directory,\n"
+        << "                  allowing decompositions of width up to 21\n"
+        << "  --td_cache      Keep the best tree decomposition of each graph in this directory,\n"
+        << "                  later runs on the same graph start from it\n"
         << "  --help          Show this help message and exit\n\n"
 
         << "By default dshunter reads the instance in .gr format from stdin.\n"
@@ -66,11 +76,14 @@ void parseArguments(int argc, char* argv[], std::string& input_file, std::string
                                      { "decomposer", required_argument, nullptr, 'd' },
                                      { "mode", required_argument, nullptr, 'm' },
                                      { "presolve", required_argument, nullptr, 'p' },
+                                     { "threads", required_argument, nullptr, 't' },
+                                     { "spill_dir", required_argument, nullptr, 'w' },
+                                     { "td_cache", required_argument, nullptr, 'c' },
                                      { "help", no_argument, nullptr, 'h' },
                                      { nullptr, 0, nullptr, 0 } };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "i:o:m:p:sh", long_options, nullptr)) != -1) {
+    while ((opt = getopt_long(argc, argv, "i:o:m:p:t:w:c:sh", long_options, nullptr)) != -1) {
         switch (opt) {
             case 'i':
                 input_file = optarg;
@@ -91,7 +104,7 @@ void parseArguments(int argc, char* argv[], std::string& input_file, std::string
                     throw std::logic_error(std::string(optarg) + " is not a valid --solver value");
                 break;
             case 'd':
-                config.decomposer_path = optarg;
+                config.decomposer_paths.emplace_back(optarg);
                 break;
             case 'p':
                 if (std::string(optarg) == "full")
@@ -104,6 +117,17 @@ void parseArguments(int argc, char* argv[], std::string& input_file, std::string
                     throw std::logic_error(std::string(optarg) +
                                            " is not a valid --presolve value");
                 break;
+            case 't':
+                config.n_threads = std::stoi(optarg);
+                if (config.n_threads < 1)
+                    throw std::logic_error(std::string(optarg) + " is not a valid --threads value");
+                break;
+            case 'w':
+                config.spill_directory = optarg;
+                break;
+            case 'c':
+                config.decomposition_cache_directory = optarg;
+                break;
             case 'm':
                 if (std::string(optarg) == "ds_size")
                     mode = SOLUTION_SIZE;